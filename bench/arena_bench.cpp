@@ -0,0 +1,194 @@
+// Бенчмарк выделений памяти при сборке ответа GET /tasks: прежняя сборка через crow::json::wvalue
+// с копиями строк из результата против JsonWriter на арене запроса. Результат бд имитируется
+// строками, которые, как и в PGresult, живут дольше сборки ответа. Выделения считаются
+// замещенным глобальным operator new
+#include "../src/crow_all.h"
+#include "../src/arena.h"
+#include "../src/json_writer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+const int TASKS = 100;
+const int TAGS_PER_TASK = 3;
+const int ITERATIONS = 2000;
+
+std::atomic<long long> allocations{ 0 };
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+// Строка результата в текстовом виде, как ее отдает libpq
+struct Row
+{
+    std::string task_id;
+    std::string task_name;
+    std::string description;
+    std::string status_id;
+    std::string priority;
+    std::string due_date;
+    std::string tag_ids;
+};
+
+std::unordered_map<int, std::string> statuses;
+std::unordered_map<int, std::string> tags;
+
+template <typename Visitor>
+void forEachId(std::string_view array, Visitor visit)
+{
+    int value = 0;
+    bool inNumber = false;
+    for (char c : array)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            value = value * 10 + (c - '0');
+            inNumber = true;
+        }
+        else if (inNumber)
+        {
+            visit(value);
+            value = 0;
+            inNumber = false;
+        }
+    }
+}
+
+// Прежняя сборка: PgResult::text копирует каждое поле, названия тегов копируются в вектор,
+// каждое поле становится узлом wvalue, затем все дерево сериализуется
+std::string buildWithWvalue(const std::vector<Row>& rows)
+{
+    crow::json::wvalue response;
+    response["tasks"] = crow::json::wvalue::list();
+
+    for (size_t i = 0; i != rows.size(); ++i)
+    {
+        const Row& row = rows[i];
+        crow::json::wvalue task;
+        task["task_id"] = std::atoi(std::string(row.task_id).c_str());
+        task["task_name"] = std::string(row.task_name);
+        task["description"] = std::string(row.description);
+        task["status"] = statuses.at(std::atoi(std::string(row.status_id).c_str()));
+        task["priority"] = std::atoi(std::string(row.priority).c_str());
+        task["due_date"] = std::string(row.due_date);
+
+        std::vector<int> ids;
+        forEachId(std::string(row.tag_ids), [&ids](int id) { ids.push_back(id); });
+        std::vector<std::string> names;
+        for (int id : ids)
+            names.push_back(tags.at(id));
+
+        task["tags"] = crow::json::wvalue::list();
+        for (size_t j = 0; j != names.size(); ++j)
+            task["tags"][j] = names[j];
+
+        response["tasks"][i] = std::move(task);
+    }
+
+    return response.dump();
+}
+
+// Новая сборка: поля читаются без копирования и сразу дописываются в строку на арене
+std::string buildWithArena(const std::vector<Row>& rows)
+{
+    RequestArena arena;
+    JsonWriter writer(arena.resource());
+
+    writer.beginObject();
+    writer.key("tasks");
+    writer.beginArray();
+    for (const Row& row : rows)
+    {
+        writer.beginObject();
+        writer.key("task_id");
+        writer.value(std::strtoll(row.task_id.c_str(), nullptr, 10));
+        writer.key("task_name");
+        writer.value(row.task_name);
+        writer.key("description");
+        writer.value(row.description);
+        writer.key("status");
+        writer.value(statuses.at(std::atoi(row.status_id.c_str())));
+        writer.key("priority");
+        writer.value(std::strtoll(row.priority.c_str(), nullptr, 10));
+        writer.key("due_date");
+        writer.value(row.due_date);
+        writer.key("tags");
+        writer.beginArray();
+        forEachId(row.tag_ids, [&](int id) { writer.value(tags.at(id)); });
+        writer.endArray();
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+
+    return std::string(writer.str()); // Тело crow::response
+}
+
+template <typename Build>
+void measure(const char* name, Build build, const std::vector<Row>& rows)
+{
+    build(rows); // Прогрев: арена получает блок потока
+
+    long long before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    size_t size = 0;
+    for (int i = 0; i != ITERATIONS; ++i)
+        size += build(rows).size();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    long long count = allocations.load() - before;
+
+    std::printf("%-8s allocs/request=%-8.1f time/request=%.1fus body=%zu bytes\n", name,
+        count / static_cast<double>(ITERATIONS), elapsed.count() / static_cast<double>(ITERATIONS), size / ITERATIONS);
+}
+
+int main()
+{
+    statuses = { { 1, "New" }, { 2, "In progress" }, { 3, "Done" } };
+    for (int i = 1; i <= 20; ++i)
+        tags[i] = "tag_" + std::to_string(i);
+
+    std::vector<Row> rows;
+    for (int i = 0; i != TASKS; ++i)
+    {
+        std::string tagIds = "{";
+        for (int j = 0; j != TAGS_PER_TASK; ++j)
+            tagIds += (j ? "," : "") + std::to_string((i + j) % 20 + 1);
+        tagIds += "}";
+
+        rows.push_back({ std::to_string(i + 1), "Task number " + std::to_string(i),
+            "Description of the task with \"quotes\" and a longer text body", std::to_string(i % 3 + 1),
+            std::to_string(i % 5), "2099-12-31", tagIds });
+    }
+
+    // Обе сборки должны давать один и тот же документ
+    auto wvalueJson = crow::json::load(buildWithWvalue(rows));
+    auto arenaJson = crow::json::load(buildWithArena(rows));
+    bool equal = wvalueJson && arenaJson && wvalueJson["tasks"].size() == arenaJson["tasks"].size();
+    for (int i = 0; equal && i != TASKS; ++i)
+    {
+        const auto& a = wvalueJson["tasks"][i];
+        const auto& b = arenaJson["tasks"][i];
+        equal = a["task_id"].i() == b["task_id"].i() && a["task_name"].s() == b["task_name"].s()
+            && a["description"].s() == b["description"].s() && a["status"].s() == b["status"].s()
+            && a["priority"].i() == b["priority"].i() && a["tags"].size() == b["tags"].size();
+    }
+    std::printf("tasks=%d tags/task=%d outputs %s\n", TASKS, TAGS_PER_TASK, equal ? "match" : "DIFFER");
+
+    measure("wvalue", buildWithWvalue, rows);
+    measure("arena", buildWithArena, rows);
+    return equal ? 0 : 1;
+}
@@ -0,0 +1,518 @@
+// Нагрузочный бенчмарк HTTP API с открытым циклом: запросы отправляются по расписанию с заданной
+// частотой, независимо от того, успел ли сервер ответить на предыдущие. Задержка считается от
+// запланированного момента отправки, а не от фактического, поэтому очередь перед занятыми
+// соединениями попадает в результат (поправка на coordinated omission, как в wrk2).
+// Результат - перцентили задержки и фактический RPS в формате JSON
+#ifdef CROW_USE_BOOST
+#include <boost/asio.hpp>
+namespace asio = boost::asio;
+using error_code = boost::system::error_code;
+#else
+#include <asio.hpp>
+using error_code = asio::error_code;
+#endif
+#include "hdr_histogram.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using asio::ip::tcp;
+
+const int USERS = 32; // Пользователей в наборе данных бенчмарка
+const int TASKS_PER_USER = 20;
+const int TAG_POOL = 16; // Теги задач выбираются из bench_tag_0..bench_tag_15
+const std::string PASSWORD = "bench_api";
+
+struct Options
+{
+    std::string scenario = "mixed";
+    double rate = 1000; // Запланированных запросов в секунду на все потоки
+    int duration = 30; // Длительность замера (сек)
+    int connections = 64;
+    int threads = 4;
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    unsigned int seed = 1;
+    std::string out; // Файл для JSON, по умолчанию stdout
+};
+
+struct Request
+{
+    std::string method;
+    std::string path;
+    std::string token;
+    std::string body;
+    int kind; // Индекс операции в сценарии, нужен для разбора ответа
+};
+
+struct Response
+{
+    int code = -1;
+    std::string body;
+};
+
+// Пользователь набора данных и его задачи
+struct BenchUser
+{
+    std::string username;
+    std::string token;
+    std::vector<int> tasks;
+};
+
+// Соединение HTTP/1.1 с keep-alive, при ошибке переподключается на следующем запросе
+class HttpConnection
+{
+public:
+    HttpConnection(asio::io_context& ctx, const tcp::resolver::results_type& endpoints)
+        : socket(ctx), endpoints(endpoints) {}
+
+    asio::awaitable<Response> request(const Request& req)
+    {
+        Response response;
+        try
+        {
+            if (!socket.is_open())
+                co_await asio::async_connect(socket, endpoints, asio::use_awaitable);
+
+            std::string data = req.method + " " + req.path + " HTTP/1.1\r\nHost: bench\r\n";
+            if (!req.token.empty())
+                data += "Authorization: Bearer " + req.token + "\r\n";
+            if (!req.body.empty())
+                data += "Content-Type: application/json\r\n";
+            data += "Content-Length: " + std::to_string(req.body.size()) + "\r\n\r\n" + req.body;
+            co_await asio::async_write(socket, asio::buffer(data), asio::use_awaitable);
+
+            size_t headerSize = co_await asio::async_read_until(socket, asio::dynamic_buffer(buffer), "\r\n\r\n", asio::use_awaitable);
+            response.code = std::atoi(buffer.c_str() + buffer.find(' ') + 1);
+
+            size_t length = 0;
+            for (const char* name : { "Content-Length: ", "content-length: " })
+            {
+                size_t pos = buffer.find(name);
+                if (pos != std::string::npos && pos < headerSize)
+                    length = std::strtoul(buffer.c_str() + pos + 16, nullptr, 10);
+            }
+
+            if (buffer.size() < headerSize + length)
+                co_await asio::async_read(socket, asio::dynamic_buffer(buffer),
+                    asio::transfer_exactly(headerSize + length - buffer.size()), asio::use_awaitable);
+
+            response.body = buffer.substr(headerSize, length);
+            buffer.erase(0, headerSize + length);
+        }
+        catch (const std::exception&)
+        {
+            error_code ec;
+            socket.close(ec);
+            buffer.clear();
+            response.code = -1;
+        }
+        co_return response;
+    }
+
+private:
+    tcp::socket socket;
+    tcp::resolver::results_type endpoints;
+    std::string buffer;
+};
+
+// Значение числового поля из JSON ответа, начиная с позиции from
+int jsonInt(const std::string& json, const std::string& field, size_t& from)
+{
+    size_t pos = json.find("\"" + field + "\":", from);
+    if (pos == std::string::npos)
+        return -1;
+    from = pos + field.size() + 3;
+    return std::atoi(json.c_str() + from);
+}
+
+std::string jsonString(const std::string& json, const std::string& field)
+{
+    size_t pos = json.find("\"" + field + "\":\"");
+    if (pos == std::string::npos)
+        return "";
+    pos += field.size() + 4;
+    return json.substr(pos, json.find('"', pos) - pos);
+}
+
+std::string tagName(int index)
+{
+    return "bench_tag_" + std::to_string(index);
+}
+
+// Операции сценариев. Веса задают долю операции в потоке запросов
+enum Operation
+{
+    GET_TASK, LIST_TASKS, LIST_ONE_TAG, LIST_TWO_TAGS, CREATE_TASK, UPDATE_TASK, PATCH_TASK,
+    ADD_COMMENT, GET_COMMENTS, UPDATE_COMMENT, DELETE_COMMENT, LOGIN
+};
+
+const std::map<std::string, std::vector<std::pair<Operation, int>>> SCENARIOS = {
+    { "read", { { GET_TASK, 100 } } },
+    { "list", { { LIST_TASKS, 30 }, { LIST_ONE_TAG, 50 }, { LIST_TWO_TAGS, 20 } } },
+    { "write", { { CREATE_TASK, 50 }, { UPDATE_TASK, 30 }, { PATCH_TASK, 20 } } },
+    { "comments", { { ADD_COMMENT, 40 }, { GET_COMMENTS, 30 }, { UPDATE_COMMENT, 15 }, { DELETE_COMMENT, 15 } } },
+    { "login", { { LOGIN, 100 } } },
+    { "mixed", { { GET_TASK, 70 }, { LIST_ONE_TAG, 10 }, { LIST_TASKS, 5 }, { CREATE_TASK, 4 }, { UPDATE_TASK, 3 },
+        { PATCH_TASK, 3 }, { ADD_COMMENT, 2 }, { GET_COMMENTS, 2 }, { DELETE_COMMENT, 1 } } },
+};
+
+std::string taskBody(std::mt19937& rng, const std::string& name)
+{
+    std::uniform_int_distribution<int> tag(0, TAG_POOL - 1);
+    std::uniform_int_distribution<int> priority(1, 5);
+    return R"({"task_name":")" + name + R"(","description":"Generated by bench_api","priority":)"
+        + std::to_string(priority(rng)) + R"(,"due_date":"2099-12-31","tags":[")" + tagName(tag(rng)) + R"(",")"
+        + tagName(tag(rng)) + R"("]})";
+}
+
+// Генератор запросов одного потока: свой ГПСЧ с фиксированным зерном и свой список созданных
+// комментариев, чтобы PUT и DELETE обращались к существующим
+class RequestGenerator
+{
+public:
+    RequestGenerator(const std::vector<BenchUser>& users, const std::vector<std::pair<Operation, int>>& mix, unsigned int seed)
+        : users(users), rng(seed)
+    {
+        std::vector<int> weights;
+        for (const auto& [operation, weight] : mix)
+        {
+            operations.push_back(operation);
+            weights.push_back(weight);
+        }
+        pick = std::discrete_distribution<int>(weights.begin(), weights.end());
+    }
+
+    Request next()
+    {
+        const BenchUser& user = users[std::uniform_int_distribution<size_t>(0, users.size() - 1)(rng)];
+        int task_id = user.tasks[std::uniform_int_distribution<size_t>(0, user.tasks.size() - 1)(rng)];
+        std::string task = "/tasks/" + std::to_string(task_id);
+        std::uniform_int_distribution<int> tag(0, TAG_POOL - 1);
+
+        Operation operation = operations[pick(rng)];
+        if ((operation == UPDATE_COMMENT || operation == DELETE_COMMENT) && comments.empty())
+            operation = ADD_COMMENT;
+
+        switch (operation)
+        {
+            case GET_TASK:
+                return { "GET", task, user.token, "", operation };
+            case LIST_TASKS:
+                return { "GET", "/tasks", user.token, "", operation };
+            case LIST_ONE_TAG:
+                return { "GET", "/tasks?tags=" + tagName(tag(rng)), user.token, "", operation };
+            case LIST_TWO_TAGS:
+                return { "GET", "/tasks?tags=" + tagName(tag(rng)) + "," + tagName(tag(rng)), user.token, "", operation };
+            case CREATE_TASK:
+                return { "POST", "/tasks", user.token, taskBody(rng, "bench created"), operation };
+            case UPDATE_TASK:
+                return { "PUT", task, user.token, taskBody(rng, "bench updated"), operation };
+            case PATCH_TASK:
+                return { "PATCH", task, user.token,
+                    R"({"priority":)" + std::to_string(tag(rng) % 5 + 1) + "}", operation };
+            case ADD_COMMENT:
+                return { "POST", task + "/comments", user.token, R"({"comment":"Comment from bench_api"})", operation };
+            case GET_COMMENTS:
+                return { "GET", task + "/comments", user.token, "", operation };
+            case UPDATE_COMMENT:
+            case DELETE_COMMENT:
+            {
+                auto [path, token] = comments[std::uniform_int_distribution<size_t>(0, comments.size() - 1)(rng)];
+                if (operation == UPDATE_COMMENT)
+                    return { "PUT", path, token, R"({"comment":"Edited by bench_api"})", operation };
+
+                // Удаленный комментарий больше не выбирается
+                for (auto it = comments.begin(); it != comments.end(); ++it)
+                {
+                    if (it->first == path)
+                    {
+                        comments.erase(it);
+                        break;
+                    }
+                }
+                return { "DELETE", path, token, "", operation };
+            }
+            case LOGIN:
+            default:
+                return { "POST", "/login", "", R"({"username":")" + user.username + R"(","password":")" + PASSWORD + R"("})", operation };
+        }
+    }
+
+    // Созданные комментарии запоминаются для последующих PUT и DELETE
+    void onResponse(const Request& req, const Response& response)
+    {
+        if (req.kind == ADD_COMMENT && response.code == 201)
+        {
+            size_t from = 0;
+            int comment_id = jsonInt(response.body, "comment_id", from);
+            if (comment_id > 0)
+                comments.emplace_back(req.path + "/" + std::to_string(comment_id), req.token);
+        }
+    }
+
+private:
+    const std::vector<BenchUser>& users;
+    std::mt19937 rng;
+    std::vector<Operation> operations;
+    std::discrete_distribution<int> pick;
+    std::deque<std::pair<std::string, std::string>> comments;
+};
+
+// Пользователи и задачи создаются один раз, при повторном запуске используются существующие
+asio::awaitable<void> prepareUsers(HttpConnection& conn, std::vector<BenchUser>& users, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    for (int i = 0; i != USERS; ++i)
+    {
+        BenchUser user;
+        user.username = "bench_api_" + std::to_string(i);
+        std::string credentials = R"({"username":")" + user.username + R"(","email":")" + user.username
+            + R"(@example.com","password":")" + PASSWORD + R"("})";
+
+        // Запросы собираются в именованные переменные: временный объект в co_await GCC уничтожает дважды
+        Request registration{ "POST", "/register", "", credentials, LOGIN };
+        co_await conn.request(registration);
+        Request loginRequest{ "POST", "/login", "", credentials, LOGIN };
+        Response login = co_await conn.request(loginRequest);
+        user.token = jsonString(login.body, "token");
+        if (user.token.empty())
+            throw std::runtime_error("Login failed for " + user.username);
+
+        Request listRequest{ "GET", "/tasks", user.token, "", LIST_TASKS };
+        Response list = co_await conn.request(listRequest);
+        size_t from = 0;
+        for (int task_id; (task_id = jsonInt(list.body, "task_id", from)) > 0 && user.tasks.size() < TASKS_PER_USER;)
+            user.tasks.push_back(task_id);
+
+        while (user.tasks.size() < TASKS_PER_USER)
+        {
+            Request create{ "POST", "/tasks", user.token, taskBody(rng, "bench task"), CREATE_TASK };
+            Response created = co_await conn.request(create);
+            size_t pos = 0;
+            int task_id = jsonInt(created.body, "task_id", pos);
+            if (task_id <= 0)
+                throw std::runtime_error("Task creation failed: " + std::to_string(created.code));
+            user.tasks.push_back(task_id);
+        }
+
+        users.push_back(std::move(user));
+    }
+}
+
+// Результаты одного потока
+struct ThreadResult
+{
+    HdrHistogram latency; // От запланированного момента до ответа (мкс)
+    HdrHistogram service; // От фактической отправки до ответа (мкс)
+    std::map<int, long long> codes;
+    long long scheduled = 0;
+};
+
+// Поток нагрузки: расписание с частотой rate, очередь запланированных запросов и connections
+// соединений, которые разбирают очередь. Если все соединения заняты, запросы ждут в очереди,
+// и это ожидание входит в задержку
+void runLoad(const Options& options, const std::vector<BenchUser>& users, double rate, int connections,
+    unsigned int seed, ThreadResult& result)
+{
+    asio::io_context ctx;
+    auto endpoints = tcp::resolver(ctx).resolve(options.host, options.port);
+
+    RequestGenerator generator(users, SCENARIOS.at(options.scenario), seed);
+    std::deque<Clock::time_point> queue;
+    asio::steady_timer wake(ctx, Clock::time_point::max());
+    bool scheduling = true;
+
+    auto start = Clock::now();
+    auto end = start + std::chrono::seconds(options.duration);
+    auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+
+    asio::co_spawn(ctx, [&]() -> asio::awaitable<void>
+    {
+        asio::steady_timer timer(ctx);
+        for (long long i = 0;; ++i)
+        {
+            auto intended = start + i * interval;
+            if (intended >= end)
+                break;
+
+            timer.expires_at(intended);
+            co_await timer.async_wait(asio::use_awaitable);
+            queue.push_back(intended);
+            ++result.scheduled;
+            wake.cancel_one();
+        }
+        scheduling = false;
+        wake.cancel();
+    }, asio::detached);
+
+    for (int i = 0; i != connections; ++i)
+    {
+        asio::co_spawn(ctx, [&]() -> asio::awaitable<void>
+        {
+            HttpConnection conn(ctx, endpoints);
+            while (true)
+            {
+                while (queue.empty() && scheduling)
+                {
+                    error_code ec;
+                    co_await wake.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+                }
+                if (queue.empty())
+                    break;
+
+                auto intended = queue.front();
+                queue.pop_front();
+
+                Request req = generator.next();
+                auto sent = Clock::now();
+                Response response = co_await conn.request(req);
+                auto done = Clock::now();
+
+                generator.onResponse(req, response);
+                result.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(done - intended).count());
+                result.service.record(std::chrono::duration_cast<std::chrono::microseconds>(done - sent).count());
+                ++result.codes[response.code];
+            }
+        }, asio::detached);
+    }
+
+    ctx.run();
+}
+
+std::string histogramJson(const HdrHistogram& histogram)
+{
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+        R"({"min":%llu,"mean":%.1f,"p50":%llu,"p90":%llu,"p99":%llu,"p99_9":%llu,"p99_99":%llu,"max":%llu})",
+        (unsigned long long)histogram.min(), histogram.mean(), (unsigned long long)histogram.percentile(50),
+        (unsigned long long)histogram.percentile(90), (unsigned long long)histogram.percentile(99),
+        (unsigned long long)histogram.percentile(99.9), (unsigned long long)histogram.percentile(99.99),
+        (unsigned long long)histogram.max());
+    return buffer;
+}
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--scenario") options.scenario = value;
+        else if (name == "--rate") options.rate = std::atof(value.c_str());
+        else if (name == "--duration") options.duration = std::atoi(value.c_str());
+        else if (name == "--connections") options.connections = std::atoi(value.c_str());
+        else if (name == "--threads") options.threads = std::atoi(value.c_str());
+        else if (name == "--host") options.host = value;
+        else if (name == "--port") options.port = value;
+        else if (name == "--seed") options.seed = std::atoi(value.c_str());
+        else if (name == "--out") options.out = value;
+        else throw std::invalid_argument("Unknown option " + name);
+    }
+
+    if (!SCENARIOS.count(options.scenario))
+        throw std::invalid_argument("Unknown scenario " + options.scenario);
+    options.threads = std::max(1, std::min(options.threads, options.connections));
+    return options;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try
+    {
+        options = parseOptions(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\nUsage: %s [--scenario read|list|write|comments|login|mixed] [--rate N] "
+            "[--duration S] [--connections N] [--threads N] [--host H] [--port P] [--seed N] [--out FILE]\n", e.what(), argv[0]);
+        return 1;
+    }
+
+    std::vector<BenchUser> users;
+    try
+    {
+        asio::io_context ctx;
+        HttpConnection conn(ctx, tcp::resolver(ctx).resolve(options.host, options.port));
+        asio::co_spawn(ctx, prepareUsers(conn, users, options.seed), [](std::exception_ptr error)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        });
+        ctx.run();
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "Setup failed: %s\n", e.what());
+        return 1;
+    }
+
+    std::vector<ThreadResult> results(options.threads);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i != options.threads; ++i)
+    {
+        int connections = options.connections / options.threads + (i < options.connections % options.threads);
+        threads.emplace_back(runLoad, std::cref(options), std::cref(users), options.rate / options.threads,
+            connections, options.seed + i + 1, std::ref(results[i]));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    ThreadResult total;
+    for (const auto& result : results)
+    {
+        total.latency.merge(result.latency);
+        total.service.merge(result.service);
+        total.scheduled += result.scheduled;
+        for (const auto& [code, count] : result.codes)
+            total.codes[code] += count;
+    }
+
+    long long errors = 0;
+    std::string codes;
+    for (const auto& [code, count] : total.codes)
+    {
+        if (code < 200 || code >= 400)
+            errors += count;
+        codes += (codes.empty() ? "" : ",") + ("\"" + std::to_string(code) + "\":" + std::to_string(count));
+    }
+
+    char header[512];
+    std::snprintf(header, sizeof(header),
+        R"({"scenario":"%s","target_rps":%.1f,"duration_s":%d,"connections":%d,"threads":%d,"seed":%u,)"
+        R"("scheduled":%lld,"completed":%llu,"errors":%lld,"achieved_rps":%.1f,)",
+        options.scenario.c_str(), options.rate, options.duration, options.connections, options.threads, options.seed,
+        total.scheduled, (unsigned long long)total.latency.count(), errors, total.latency.count() / elapsed);
+
+    std::string json = std::string(header) + R"("latency_us":)" + histogramJson(total.latency)
+        + R"(,"service_time_us":)" + histogramJson(total.service) + R"(,"status_codes":{)" + codes + "}}\n";
+
+    if (options.out.empty())
+    {
+        std::fputs(json.c_str(), stdout);
+    }
+    else
+    {
+        FILE* file = std::fopen(options.out.c_str(), "w");
+        if (!file)
+        {
+            std::fprintf(stderr, "Cannot write %s\n", options.out.c_str());
+            return 1;
+        }
+        std::fputs(json.c_str(), file);
+        std::fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Генератор синтетического набора данных для нагрузочных тестов и проверки планов запросов.
+// Пользователи, теги, задачи, связи задач с тегами и комментарии загружаются через COPY.
+// Распределения с тяжелым хвостом (Ципф): число задач у пользователя, популярность тегов,
+// число тегов у задачи, число комментариев и их длина. Все значения выводятся из зерна и id
+// строки, поэтому каждая таблица генерируется отдельным проходом без хранения данных в памяти
+#include <libpq-fe.h>
+#include <argon2.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const size_t COPY_CHUNK = 1 << 20; // Размер порции данных COPY (байт)
+const std::string PASSWORD = "password"; // Пароль пользователей, которым можно войти
+
+struct Options
+{
+    std::string conninfo = "host=localhost port=5432 dbname=taskManager user=postgres password=1234";
+    long long users = 100000;
+    double tasksPerUser = 20; // Среднее число задач на пользователя
+    double taskSkew = 1.1; // Показатель Ципфа для числа задач у пользователя
+    long long maxTasksPerUser = 20000;
+    int tags = 5000;
+    double tagSkew = 1.0; // Популярность тегов
+    int maxTagsPerTask = 8;
+    double tagsPerTaskSkew = 1.5;
+    int maxCommentsPerTask = 20;
+    double commentsSkew = 1.6;
+    int maxCommentWords = 200;
+    double commentSizeSkew = 1.2;
+    int loginUsers = 100; // Первым N пользователям считается настоящий хеш пароля
+    unsigned int seed = 1;
+};
+
+// Выборка рангов 1..n с вероятностью, пропорциональной 1/rank^s, через таблицу накопленных весов
+class ZipfSampler
+{
+public:
+    ZipfSampler(int n, double s) : cumulative(n)
+    {
+        double sum = 0;
+        for (int rank = 1; rank <= n; ++rank)
+        {
+            sum += 1.0 / std::pow(rank, s);
+            cumulative[rank - 1] = sum;
+        }
+    }
+
+    int operator()(std::mt19937_64& rng) const
+    {
+        double point = std::uniform_real_distribution<double>(0, cumulative.back())(rng);
+        return static_cast<int>(std::upper_bound(cumulative.begin(), cumulative.end(), point) - cumulative.begin()) + 1;
+    }
+
+private:
+    std::vector<double> cumulative;
+};
+
+// Отдельный ГПСЧ для каждой строки: значения не зависят от порядка проходов
+std::mt19937_64 rowRng(unsigned int seed, int table, long long id)
+{
+    std::seed_seq seq{ seed, static_cast<unsigned int>(table), static_cast<unsigned int>(id), static_cast<unsigned int>(id >> 32) };
+    return std::mt19937_64(seq);
+}
+
+std::string words(std::mt19937_64& rng, int count)
+{
+    static const char* const DICTIONARY[] = { "review", "deploy", "update", "fix", "report", "design", "client",
+        "server", "cache", "query", "index", "release", "meeting", "budget", "draft", "test", "migrate", "backup",
+        "invoice", "plan", "refactor", "docs", "support", "audit" };
+    std::uniform_int_distribution<int> pick(0, std::size(DICTIONARY) - 1);
+
+    std::string result;
+    for (int i = 0; i != count; ++i)
+        result += (i ? " " : "") + std::string(DICTIONARY[pick(rng)]);
+    return result;
+}
+
+class Database
+{
+public:
+    explicit Database(const std::string& conninfo) : conn(PQconnectdb(conninfo.c_str()))
+    {
+        if (PQstatus(conn) != CONNECTION_OK)
+            throw std::runtime_error(PQerrorMessage(conn));
+    }
+
+    ~Database() { PQfinish(conn); }
+
+    void exec(const std::string& sql)
+    {
+        PGresult* res = PQexec(conn, sql.c_str());
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK || PQresultStatus(res) == PGRES_TUPLES_OK;
+        PQclear(res);
+        if (!ok)
+            throw std::runtime_error(PQerrorMessage(conn));
+    }
+
+    long long scalar(const std::string& sql)
+    {
+        PGresult* res = PQexec(conn, sql.c_str());
+        if (PQresultStatus(res) != PGRES_TUPLES_OK)
+        {
+            PQclear(res);
+            throw std::runtime_error(PQerrorMessage(conn));
+        }
+        long long value = std::strtoll(PQgetvalue(res, 0, 0), nullptr, 10);
+        PQclear(res);
+        return value;
+    }
+
+    // Загрузка таблицы через COPY FROM STDIN в текстовом формате. Генерируемые строки содержат
+    // только буквы, цифры, пробелы и дефисы, поэтому экранирование не нужно
+    template <typename Generate>
+    long long copy(const std::string& table, const std::string& columns, Generate generate)
+    {
+        auto start = std::chrono::steady_clock::now();
+        PGresult* res = PQexec(conn, ("COPY " + table + " (" + columns + ") FROM STDIN").c_str());
+        bool started = PQresultStatus(res) == PGRES_COPY_IN;
+        PQclear(res);
+        if (!started)
+            throw std::runtime_error(PQerrorMessage(conn));
+
+        std::string buffer;
+        long long rows = 0;
+        auto flush = [&]
+        {
+            if (PQputCopyData(conn, buffer.data(), buffer.size()) != 1)
+                throw std::runtime_error(PQerrorMessage(conn));
+            buffer.clear();
+        };
+
+        generate([&](const std::string& row)
+        {
+            buffer += row;
+            buffer += '\n';
+            ++rows;
+            if (buffer.size() >= COPY_CHUNK)
+                flush();
+        });
+        flush();
+
+        if (PQputCopyEnd(conn, nullptr) != 1)
+            throw std::runtime_error(PQerrorMessage(conn));
+        res = PQgetResult(conn);
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if (!ok)
+            throw std::runtime_error(PQerrorMessage(conn));
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::fprintf(stderr, "%-10s %12lld rows %8.1fs %10.0f rows/s\n", table.c_str(), rows, seconds, rows / seconds);
+        return rows;
+    }
+
+private:
+    PGconn* conn;
+};
+
+// Число задач у каждого пользователя: ранги по Ципфу, нормированные на среднее, и случайная
+// перестановка рангов, чтобы самые активные пользователи не шли подряд
+std::vector<long long> tasksPerUser(const Options& options)
+{
+    std::vector<double> weights(options.users);
+    for (long long rank = 1; rank <= options.users; ++rank)
+        weights[rank - 1] = 1.0 / std::pow(rank, options.taskSkew);
+    double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+    double total = options.tasksPerUser * options.users;
+
+    std::vector<long long> counts(options.users);
+    for (long long i = 0; i != options.users; ++i)
+        counts[i] = std::min<long long>(options.maxTasksPerUser, std::llround(total * weights[i] / sum));
+
+    std::mt19937_64 rng(options.seed);
+    std::shuffle(counts.begin(), counts.end(), rng);
+    return counts;
+}
+
+std::string passwordHash(const std::string& salt)
+{
+    char hash[16];
+    char encoded[128];
+    // Те же параметры argon2id, что и в auth::hashPassword
+    if (argon2id_hash_encoded(1, 1 << 10, 2, PASSWORD.c_str(), PASSWORD.size(), salt.c_str(), salt.size(),
+        sizeof(hash), encoded, sizeof(encoded)) != ARGON2_OK)
+        throw std::runtime_error("Failed to hash password");
+    return encoded;
+}
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        const char* value = argv[i + 1];
+        if (name == "--conninfo") options.conninfo = value;
+        else if (name == "--users") options.users = std::atoll(value);
+        else if (name == "--tasks-per-user") options.tasksPerUser = std::atof(value);
+        else if (name == "--task-skew") options.taskSkew = std::atof(value);
+        else if (name == "--max-tasks-per-user") options.maxTasksPerUser = std::atoll(value);
+        else if (name == "--tags") options.tags = std::atoi(value);
+        else if (name == "--tag-skew") options.tagSkew = std::atof(value);
+        else if (name == "--max-tags-per-task") options.maxTagsPerTask = std::atoi(value);
+        else if (name == "--tags-per-task-skew") options.tagsPerTaskSkew = std::atof(value);
+        else if (name == "--max-comments-per-task") options.maxCommentsPerTask = std::atoi(value);
+        else if (name == "--comments-skew") options.commentsSkew = std::atof(value);
+        else if (name == "--max-comment-words") options.maxCommentWords = std::atoi(value);
+        else if (name == "--comment-size-skew") options.commentSizeSkew = std::atof(value);
+        else if (name == "--login-users") options.loginUsers = std::atoi(value);
+        else if (name == "--seed") options.seed = std::atoi(value);
+        else throw std::invalid_argument("Unknown option " + name);
+    }
+    if (options.users <= 0 || options.tags <= 0)
+        throw std::invalid_argument("--users and --tags must be positive");
+    return options;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try
+    {
+        options = parseOptions(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\nUsage: %s [--conninfo STR] [--users N] [--tasks-per-user MEAN] [--task-skew S] "
+            "[--max-tasks-per-user N] [--tags N] [--tag-skew S] [--max-tags-per-task N] [--tags-per-task-skew S] "
+            "[--max-comments-per-task N] [--comments-skew S] [--max-comment-words N] [--comment-size-skew S] "
+            "[--login-users N] [--seed N]\n", e.what(), argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        Database db(options.conninfo);
+
+        // Новые строки добавляются после существующих, поэтому генератор можно запускать на рабочей бд
+        long long userBase = db.scalar("SELECT COALESCE(max(user_id), 0) FROM users");
+        long long tagBase = db.scalar("SELECT COALESCE(max(tag_id), 0) FROM tags");
+        long long taskBase = db.scalar("SELECT COALESCE(max(task_id), 0) FROM tasks");
+        long long commentBase = db.scalar("SELECT COALESCE(max(comment_id), 0) FROM comments");
+        int statuses = static_cast<int>(db.scalar("SELECT count(*) FROM task_statuses"));
+
+        std::vector<long long> counts = tasksPerUser(options);
+        long long totalTasks = std::accumulate(counts.begin(), counts.end(), 0LL);
+        std::fprintf(stderr, "users=%lld tasks=%lld (max %lld per user) tags=%d seed=%u\n", options.users, totalTasks,
+            *std::max_element(counts.begin(), counts.end()), options.tags, options.seed);
+
+        db.exec("BEGIN");
+
+        db.copy("users", "user_id, username, email, password, salt", [&](auto emit)
+        {
+            std::string placeholder = "!generated"; // Не совпадает ни с одним хешем, войти нельзя
+            for (long long i = 1; i <= options.users; ++i)
+            {
+                std::string id = std::to_string(userBase + i);
+                std::string salt = "gen-salt-" + id;
+                std::string hash = i <= options.loginUsers ? passwordHash(salt) : placeholder;
+                emit(id + "\tgen_user_" + id + "\tgen_user_" + id + "@example.com\t" + hash + "\t" + salt);
+            }
+        });
+
+        db.copy("tags", "tag_id, tag_name", [&](auto emit)
+        {
+            for (long long i = 1; i <= options.tags; ++i)
+                emit(std::to_string(tagBase + i) + "\tgen-tag-" + std::to_string(tagBase + i));
+        });
+
+        ZipfSampler descriptionWords(40, 1.0);
+        db.copy("tasks", "task_id, user_id, status_id, task_name, description, priority, due_date", [&](auto emit)
+        {
+            long long task_id = taskBase;
+            for (long long user = 0; user != options.users; ++user)
+            {
+                for (long long n = 0; n != counts[user]; ++n)
+                {
+                    ++task_id;
+                    auto rng = rowRng(options.seed, 1, task_id);
+                    int status = std::uniform_int_distribution<int>(1, std::max(statuses, 1))(rng);
+                    int priority = std::uniform_int_distribution<int>(0, 5)(rng);
+                    int day = std::uniform_int_distribution<int>(0, 3 * 365)(rng);
+                    char due[16];
+                    std::snprintf(due, sizeof(due), "%04d-%02d-%02d", 2024 + day / 365, day % 365 / 31 % 12 + 1, day % 28 + 1);
+
+                    // Название уникально в пределах пользователя за счет task_id
+                    std::string name = words(rng, 3) + " " + std::to_string(task_id);
+                    std::string description = words(rng, descriptionWords(rng));
+                    emit(std::to_string(task_id) + "\t" + std::to_string(userBase + user + 1) + "\t" + std::to_string(status)
+                        + "\t" + name + "\t" + description + "\t" + std::to_string(priority) + "\t" + due);
+                }
+            }
+        });
+
+        // Число тегов у задачи: ранг 1 - задача без тегов, далее по убыванию вероятности
+        ZipfSampler tagsPerTask(options.maxTagsPerTask + 1, options.tagsPerTaskSkew);
+        ZipfSampler tagPopularity(options.tags, options.tagSkew);
+        db.copy("task_tags", "task_id, tag_id", [&](auto emit)
+        {
+            std::vector<int> chosen;
+            for (long long task_id = taskBase + 1; task_id <= taskBase + totalTasks; ++task_id)
+            {
+                auto rng = rowRng(options.seed, 2, task_id);
+                int count = tagsPerTask(rng) - 1;
+                chosen.clear();
+                for (int attempt = 0; static_cast<int>(chosen.size()) < count && attempt != count * 4; ++attempt)
+                {
+                    int tag = tagPopularity(rng);
+                    if (std::find(chosen.begin(), chosen.end(), tag) == chosen.end())
+                        chosen.push_back(tag);
+                }
+                for (int tag : chosen)
+                    emit(std::to_string(task_id) + "\t" + std::to_string(tagBase + tag));
+            }
+        });
+
+        // Комментарии оставляет владелец задачи, поэтому нужен проход по пользователям
+        ZipfSampler commentsPerTask(options.maxCommentsPerTask + 1, options.commentsSkew);
+        ZipfSampler commentWords(options.maxCommentWords, options.commentSizeSkew);
+        db.copy("comments", "comment_id, task_id, user_id, comment", [&](auto emit)
+        {
+            long long comment_id = commentBase;
+            long long task_id = taskBase;
+            for (long long user = 0; user != options.users; ++user)
+            {
+                for (long long n = 0; n != counts[user]; ++n)
+                {
+                    ++task_id;
+                    auto rng = rowRng(options.seed, 3, task_id);
+                    for (int c = commentsPerTask(rng) - 1; c > 0; --c)
+                        emit(std::to_string(++comment_id) + "\t" + std::to_string(task_id) + "\t"
+                            + std::to_string(userBase + user + 1) + "\t" + words(rng, commentWords(rng)));
+                }
+            }
+        });
+
+        // Версия списка задач нужна для ETag, последовательности продолжаются после новых id
+        db.exec("UPDATE users SET tasks_version = 1 WHERE user_id > " + std::to_string(userBase));
+        db.exec("SELECT setval('public.users_user_id_seq', (SELECT max(user_id) FROM users))");
+        db.exec("SELECT setval('public.tags_tag_id_seq', (SELECT max(tag_id) FROM tags))");
+        db.exec("SELECT setval('public.tasks_task_id_seq', GREATEST((SELECT max(task_id) FROM tasks), 1))");
+        db.exec("SELECT setval('public.comments_comment_id_seq', GREATEST((SELECT max(comment_id) FROM comments), 1))");
+        db.exec("COMMIT");
+
+        // Статистика планировщика должна отражать новые объемы
+        db.exec("ANALYZE users, tags, tasks, task_tags, comments");
+        std::fprintf(stderr, "Done. Users gen_user_%lld..gen_user_%lld, the first %d can log in with password \"%s\"\n",
+            userBase + 1, userBase + options.users, std::min<int>(options.loginUsers, options.users), PASSWORD.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "Generation failed: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Гистограмма задержек в духе HdrHistogram: на каждую степень двойки приходится 2^SUB_BITS
+// линейных корзин, поэтому относительная погрешность любого перцентиля не больше 2^-SUB_BITS
+// при фиксированном объеме памяти. Гистограммы потоков складываются без потери точности
+class HdrHistogram
+{
+public:
+    static const int SUB_BITS = 7; // 128 корзин на степень двойки, погрешность < 0.8%
+    static const int SUB_COUNT = 1 << SUB_BITS;
+
+    HdrHistogram() : counts((64 - SUB_BITS + 1) * SUB_COUNT, 0), total(0), sum(0), minValue(UINT64_MAX), maxValue(0) {}
+
+    void record(uint64_t value)
+    {
+        ++counts[index(value)];
+        ++total;
+        sum += value;
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+    }
+
+    void merge(const HdrHistogram& other)
+    {
+        for (size_t i = 0; i != counts.size(); ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        minValue = std::min(minValue, other.minValue);
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    // Наибольшее значение, неотличимое от значения на перцентиле percentile (0..100)
+    uint64_t percentile(double percentile) const
+    {
+        if (total == 0)
+            return 0;
+
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, total);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i != counts.size(); ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(highestEquivalent(i), maxValue);
+        }
+        return maxValue;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? minValue : 0; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return total ? static_cast<double>(sum) / total : 0.0; }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minValue;
+    uint64_t maxValue;
+
+    static size_t index(uint64_t value)
+    {
+        if (value < SUB_COUNT)
+            return value;
+
+        int exponent = 63 - __builtin_clzll(value);
+        int shift = exponent - SUB_BITS;
+        uint64_t sub = (value >> shift) - SUB_COUNT;
+        return (shift + 1) * SUB_COUNT + sub;
+    }
+
+    static uint64_t highestEquivalent(size_t index)
+    {
+        if (index < SUB_COUNT)
+            return index;
+
+        int shift = static_cast<int>(index / SUB_COUNT) - 1;
+        uint64_t sub = index % SUB_COUNT;
+        return ((SUB_COUNT + sub) << shift) + (uint64_t(1) << shift) - 1;
+    }
+};
+
+#endif
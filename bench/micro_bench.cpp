@@ -0,0 +1,390 @@
+// Микробенчмарки функций, которые выполняются на каждом запросе. Входные данные генерируются
+// с фиксированным зерном, поэтому разные сборки измеряются на одних и тех же данных, а
+// регрессия в одной функции видна отдельно от бд, Redis и сети
+#include <benchmark/benchmark.h>
+#include "../src/access_log.h"
+#include "../src/auth.h"
+#include "../src/cache.h"
+#include "../src/dictionary.h"
+#include "../src/fairness.h"
+#include "../src/rate_limit.h"
+#include "../src/json_writer.h"
+#include "../src/arena.h"
+#include "../src/tag.h"
+#include "../src/task.h"
+#include "../src/trace.h"
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+const unsigned int SEED = 42;
+const int TAG_COUNT = 200; // Тегов в словаре
+const int STATUS_COUNT = 3;
+
+// Генератор типичных входных данных
+struct Inputs
+{
+    std::mt19937 rng{ SEED };
+
+    std::string word(int minLength, int maxLength)
+    {
+        std::uniform_int_distribution<int> length(minLength, maxLength);
+        std::uniform_int_distribution<int> letter('a', 'z');
+        std::string result(length(rng), ' ');
+        for (char& c : result)
+            c = static_cast<char>(letter(rng));
+        return result;
+    }
+
+    std::string sentence(int words)
+    {
+        std::string result;
+        for (int i = 0; i != words; ++i)
+            result += (i ? " " : "") + word(2, 10);
+        return result;
+    }
+
+    int number(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(rng);
+    }
+
+    // Массив id тегов в формате Postgres, как его возвращает ARRAY(...)
+    std::string tagIds(int count)
+    {
+        std::string result = "{";
+        for (int i = 0; i != count; ++i)
+            result += (i ? "," : "") + std::to_string(number(1, TAG_COUNT));
+        return result + "}";
+    }
+
+    std::string taskBody(int tags)
+    {
+        std::string body = R"({"task_name":")" + sentence(3) + R"(","description":")" + sentence(20)
+            + R"(","priority":)" + std::to_string(number(1, 5)) + R"(,"due_date":"2099-12-31","tags":[)";
+        for (int i = 0; i != tags; ++i)
+            body += std::string(i ? "," : "") + "\"" + word(3, 12) + "\"";
+        return body + "]}";
+    }
+};
+
+Dictionaries::Snapshot dictionarySnapshot()
+{
+    Inputs inputs;
+    std::vector<std::pair<int, std::string>> statuses{ { 1, "New" }, { 2, "In progress" }, { 3, "Done" } };
+    std::vector<std::pair<int, std::string>> tags;
+    for (int i = 1; i <= TAG_COUNT; ++i)
+        tags.emplace_back(i, inputs.word(3, 12));
+    return Dictionaries::Snapshot::fromLists(statuses, tags);
+}
+
+// Задача в том виде, в котором ее отдает GET
+struct TaskRow
+{
+    int task_id;
+    std::string task_name;
+    std::string description;
+    std::string status;
+    int priority;
+    std::string due_date;
+    std::vector<std::string> tags;
+};
+
+std::vector<TaskRow> taskRows(int count)
+{
+    Inputs inputs;
+    std::vector<TaskRow> rows;
+    for (int i = 0; i != count; ++i)
+    {
+        TaskRow row{ i + 1, inputs.sentence(3), inputs.sentence(20), "In progress", inputs.number(1, 5), "2099-12-31" };
+        for (int j = inputs.number(0, 4); j != 0; --j)
+            row.tags.push_back(inputs.word(3, 12));
+        rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+static void BM_CheckToken(benchmark::State& state)
+{
+    crow::request req;
+    req.add_header("Authorization", "Bearer " + auth::generateToken(12345));
+
+    for (auto _ : state)
+    {
+        int user_id = 0;
+        benchmark::DoNotOptimize(auth::checkToken(req, user_id));
+        benchmark::DoNotOptimize(user_id);
+    }
+}
+BENCHMARK(BM_CheckToken);
+
+static void BM_CheckTokenInvalid(benchmark::State& state)
+{
+    crow::request req;
+    std::string token = auth::generateToken(12345);
+    token.back() = token.back() == 'A' ? 'B' : 'A'; // Подпись не сходится
+    req.add_header("Authorization", "Bearer " + token);
+
+    for (auto _ : state)
+    {
+        int user_id = 0;
+        benchmark::DoNotOptimize(auth::checkToken(req, user_id));
+    }
+}
+BENCHMARK(BM_CheckTokenInvalid);
+
+static void BM_GenerateToken(benchmark::State& state)
+{
+    int user_id = 1;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(auth::generateToken(user_id++));
+}
+BENCHMARK(BM_GenerateToken);
+
+static void BM_ParseIdArray(benchmark::State& state)
+{
+    Inputs inputs;
+    std::string ids = inputs.tagIds(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(parseIdArray(ids));
+}
+BENCHMARK(BM_ParseIdArray)->Arg(0)->Arg(3)->Arg(20);
+
+// Добавление тегов задачи в ответ: разбор массива id и поиск названий в снимке справочника
+static void BM_WriteTagNames(benchmark::State& state)
+{
+    Inputs inputs;
+    auto names = dictionarySnapshot();
+    std::string ids = inputs.tagIds(state.range(0));
+
+    for (auto _ : state)
+    {
+        RequestArena arena;
+        JsonWriter writer(arena.resource());
+        writer.beginObject();
+        tag::writeTagNames(ids, names, writer);
+        writer.endObject();
+        benchmark::DoNotOptimize(writer.str().data());
+    }
+}
+BENCHMARK(BM_WriteTagNames)->Arg(0)->Arg(3)->Arg(20);
+
+static void BM_BuildQueryWithFilterTags(benchmark::State& state)
+{
+    Inputs inputs;
+    std::string filter;
+    for (int i = 0; i != state.range(0); ++i)
+        filter += (i ? "," : "") + inputs.word(3, 12);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(task::buildQueryWithFilterTags(12345, filter));
+}
+BENCHMARK(BM_BuildQueryWithFilterTags)->Arg(0)->Arg(2);
+
+static void BM_CreateCacheKey(benchmark::State& state)
+{
+    int task_id = 1;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(createCacheKey(task_id++, 12345));
+}
+BENCHMARK(BM_CreateCacheKey);
+
+static void BM_JsonLoadLogin(benchmark::State& state)
+{
+    std::string body = R"({"username":"test_user","password":"1234"})";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(crow::json::load(body));
+}
+BENCHMARK(BM_JsonLoadLogin);
+
+static void BM_JsonLoadTask(benchmark::State& state)
+{
+    Inputs inputs;
+    std::string body = inputs.taskBody(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(crow::json::load(body));
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_JsonLoadTask)->Arg(0)->Arg(5);
+
+static void BM_JsonLoadComment(benchmark::State& state)
+{
+    Inputs inputs;
+    std::string body = R"({"comment":")" + inputs.sentence(30) + R"("})";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(crow::json::load(body));
+}
+BENCHMARK(BM_JsonLoadComment);
+
+// Список задач через crow::json::wvalue: сборка дерева и dump
+static void BM_WvalueDumpTaskList(benchmark::State& state)
+{
+    auto rows = taskRows(state.range(0));
+    for (auto _ : state)
+    {
+        crow::json::wvalue response;
+        response["tasks"] = crow::json::wvalue::list();
+        for (size_t i = 0; i != rows.size(); ++i)
+        {
+            crow::json::wvalue task;
+            task["task_id"] = rows[i].task_id;
+            task["task_name"] = rows[i].task_name;
+            task["description"] = rows[i].description;
+            task["status"] = rows[i].status;
+            task["priority"] = rows[i].priority;
+            task["due_date"] = rows[i].due_date;
+            task["tags"] = crow::json::wvalue::list();
+            for (size_t j = 0; j != rows[i].tags.size(); ++j)
+                task["tags"][j] = rows[i].tags[j];
+            response["tasks"][i] = std::move(task);
+        }
+        benchmark::DoNotOptimize(response.dump());
+    }
+}
+BENCHMARK(BM_WvalueDumpTaskList)->Arg(1)->Arg(10)->Arg(100);
+
+// Тот же список через JsonWriter на арене, как его собирает сервер
+static void BM_JsonWriterTaskList(benchmark::State& state)
+{
+    auto rows = taskRows(state.range(0));
+    for (auto _ : state)
+    {
+        RequestArena arena;
+        JsonWriter writer(arena.resource());
+        writer.beginObject();
+        writer.key("tasks");
+        writer.beginArray();
+        for (const auto& row : rows)
+        {
+            writer.beginObject();
+            writer.key("task_id");
+            writer.value(row.task_id);
+            writer.key("task_name");
+            writer.value(row.task_name);
+            writer.key("description");
+            writer.value(row.description);
+            writer.key("status");
+            writer.value(row.status);
+            writer.key("priority");
+            writer.value(row.priority);
+            writer.key("due_date");
+            writer.value(row.due_date);
+            writer.key("tags");
+            writer.beginArray();
+            for (const auto& tag : row.tags)
+                writer.value(tag);
+            writer.endArray();
+            writer.endObject();
+        }
+        writer.endArray();
+        writer.endObject();
+        benchmark::DoNotOptimize(std::string(writer.str()));
+    }
+}
+BENCHMARK(BM_JsonWriterTaskList)->Arg(1)->Arg(10)->Arg(100);
+
+// Трассировка GET /tasks/{task_id} с теми же этапами, что и в обработчике. Без выборки это
+// цена трассировки для всех запросов, с traceparent от клиента - для выбранных. Очередь
+// экспортера быстро заполняется, дальше спаны отбрасываются, так что файл не растет
+static void traceRequest(const crow::request& req)
+{
+    trace::Trace requestTrace(req, "GET /tasks/{task_id}");
+    {
+        trace::Span span(&requestTrace, "auth.check_token");
+    }
+    {
+        trace::Span span(&requestTrace, "redis.get_task");
+        span.attribute("cache.result", "miss");
+    }
+    {
+        trace::Span load(&requestTrace, "task.load");
+        trace::Span wait(&requestTrace, "db.pool_wait");
+        wait.end();
+        trace::Span query(&requestTrace, "db.query");
+        query.end();
+        trace::Span render(&requestTrace, "json.render");
+    }
+    benchmark::DoNotOptimize(requestTrace.finish(crow::response(200)));
+}
+
+static void BM_TraceUnsampled(benchmark::State& state)
+{
+    crow::request req;
+    req.url = "/tasks/1";
+    for (auto _ : state)
+        traceRequest(req);
+}
+BENCHMARK(BM_TraceUnsampled);
+
+static void BM_TraceSampled(benchmark::State& state)
+{
+    crow::request req;
+    req.url = "/tasks/1";
+    req.add_header("traceparent", "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01");
+    for (auto _ : state)
+        traceRequest(req);
+}
+BENCHMARK(BM_TraceSampled);
+
+// Цена журнала запросов для потока запроса: запись в кольцевой буфер. Поток записи успевает не
+// за всеми, лишние записи отбрасываются, что и проверяет работу под нагрузкой
+static void BM_AccessLogSubmit(benchmark::State& state)
+{
+    accesslog::Entry entry;
+    entry.status = 200;
+    entry.user_id = 12345;
+    std::strcpy(entry.route, "/tasks/{id}");
+    auto& writer = accesslog::Writer::getInstance();
+    for (auto _ : state)
+        writer.submit(entry);
+}
+BENCHMARK(BM_AccessLogSubmit)->Threads(1)->Threads(4);
+
+// Цена обращения к кэшу, пока Redis недоступен: автомат защиты открыт и отклоняет вызов сразу
+static void BM_CircuitBreakerRejected(benchmark::State& state)
+{
+    CircuitBreaker breaker("bench", 1, std::chrono::hours(1), std::chrono::hours(1));
+    breaker.failure();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(breaker.allow());
+}
+BENCHMARK(BM_CircuitBreakerRejected)->Threads(1)->Threads(4);
+
+// Цена ограничителя для принятого запроса: занять место и вернуть его с замером задержки
+static void BM_AdmissionAcquireRelease(benchmark::State& state)
+{
+    static admission::Limiter limiter;
+    for (auto _ : state)
+    {
+        if (limiter.tryAcquire())
+            limiter.release(std::chrono::microseconds(500));
+    }
+}
+BENCHMARK(BM_AdmissionAcquireRelease)->Threads(1)->Threads(4);
+
+// Счетчики пользователей: у каждого потока свой пользователь, как у запросов разных пользователей
+static void BM_UserCountersAcquireRelease(benchmark::State& state)
+{
+    auto& counters = fairness::userCounters();
+    int user_id = 1000 + state.thread_index();
+    for (auto _ : state)
+    {
+        if (counters.tryAcquire(user_id, USER_MAX_CONCURRENT))
+            counters.release(user_id);
+    }
+}
+BENCHMARK(BM_UserCountersAcquireRelease)->Threads(1)->Threads(4);
+
+// Проверка частоты запросов на горячем пути: только локальная корзина, без Redis
+static void BM_RateLimitConsume(benchmark::State& state)
+{
+    auto& limiter = ratelimit::Limiter::getInstance();
+    std::string key = "bench:user:" + std::to_string(state.thread_index());
+    ratelimit::Limit limit{ 1e9, 1e9 };
+    for (auto _ : state)
+        benchmark::DoNotOptimize(limiter.tryConsume(key, limit));
+}
+BENCHMARK(BM_RateLimitConsume)->Threads(1)->Threads(4);
+
+BENCHMARK_MAIN();
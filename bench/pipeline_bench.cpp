@@ -0,0 +1,328 @@
+// Бенчмарк записи задачи с 10 тегами через сеть с RTT 1 мс. Между бенчмарком и Postgres стоит
+// прокси, который задерживает каждый пакет на половину RTT в каждую сторону. Сравниваются
+// прежняя привязка тегов по одному, транзакция из последовательных запросов и pipeline
+#include <pqxx/pqxx>
+#include <libpq-fe.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+
+const int ITERATIONS = 200;
+const int TAGS = 10;
+const auto RTT = std::chrono::microseconds(1000);
+
+// Прокси с задержкой: для каждого соединения два направления, в каждом поток чтения ставит
+// пакеты в очередь с временем отправки, а поток записи отправляет их, когда время наступило
+class LatencyProxy
+{
+public:
+    LatencyProxy(const std::string& host, const std::string& port, std::chrono::microseconds oneWay)
+        : host(host), upstreamPort(port), oneWay(oneWay)
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0)
+            throw std::runtime_error("Proxy: cannot listen");
+
+        socklen_t len = sizeof(addr);
+        getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+        localPort = ntohs(addr.sin_port);
+
+        std::thread([this] { acceptLoop(); }).detach();
+    }
+
+    int port() const { return localPort; }
+
+private:
+    struct Chunk
+    {
+        std::chrono::steady_clock::time_point due;
+        std::string data; // Пустой блок означает конец потока
+    };
+
+    struct Direction
+    {
+        std::mutex mtx;
+        std::condition_variable ready;
+        std::deque<Chunk> chunks;
+    };
+
+    std::string host;
+    std::string upstreamPort;
+    std::chrono::microseconds oneWay;
+    int listener;
+    int localPort;
+
+    void acceptLoop()
+    {
+        while (true)
+        {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0)
+                continue;
+
+            int upstream = connectUpstream();
+            if (upstream < 0)
+            {
+                close(client);
+                continue;
+            }
+
+            pump(client, upstream);
+            pump(upstream, client);
+        }
+    }
+
+    int connectUpstream()
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* info = nullptr;
+        if (getaddrinfo(host.c_str(), upstreamPort.c_str(), &hints, &info) != 0)
+            return -1;
+
+        int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (connect(fd, info->ai_addr, info->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(info);
+
+        if (fd >= 0)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd;
+    }
+
+    void pump(int from, int to)
+    {
+        auto direction = std::make_shared<Direction>();
+
+        std::thread([this, from, direction]
+        {
+            char buffer[16384];
+            while (true)
+            {
+                ssize_t n = read(from, buffer, sizeof(buffer));
+                std::lock_guard<std::mutex> lock(direction->mtx);
+                direction->chunks.push_back({ std::chrono::steady_clock::now() + oneWay,
+                    n > 0 ? std::string(buffer, n) : std::string() });
+                direction->ready.notify_one();
+                if (n <= 0)
+                    break;
+            }
+        }).detach();
+
+        std::thread([from, to, direction]
+        {
+            while (true)
+            {
+                Chunk chunk;
+                {
+                    std::unique_lock<std::mutex> lock(direction->mtx);
+                    direction->ready.wait(lock, [&] { return !direction->chunks.empty(); });
+                    chunk = std::move(direction->chunks.front());
+                    direction->chunks.pop_front();
+                }
+
+                if (chunk.data.empty())
+                {
+                    shutdown(to, SHUT_WR);
+                    break;
+                }
+
+                std::this_thread::sleep_until(chunk.due);
+                size_t sent = 0;
+                while (sent < chunk.data.size())
+                {
+                    ssize_t n = write(to, chunk.data.data() + sent, chunk.data.size() - sent);
+                    if (n <= 0)
+                        return;
+                    sent += n;
+                }
+            }
+        }).detach();
+    }
+};
+
+const std::string INSERT_TASK = R"(WITH ins AS (
+    INSERT INTO tasks (user_id, task_name, description, status_id, priority, due_date)
+    VALUES ($1, $2, $3, $4, $5, $6) RETURNING task_id, status_id, due_date, version),
+    ver AS (
+    UPDATE users SET tasks_version = tasks_version + 1 WHERE user_id = $1 RETURNING tasks_version)
+    SELECT ins.task_id, ins.status_id, ins.due_date, ins.version, ver.tasks_version
+    FROM ins
+    CROSS JOIN ver)";
+
+// Создание и привязка тегов, как в tag::addTagsToNewTaskQueries (все теги считаются неизвестными)
+const std::string INSERT_TAGS = R"(INSERT INTO tags (tag_name) SELECT unnest($1::text[])
+    ON CONFLICT (tag_name) DO NOTHING
+    RETURNING tag_id, tag_name)";
+
+const std::string LINK_TAGS = R"(WITH linked AS (
+    INSERT INTO task_tags (task_id, tag_id)
+    SELECT currval('public.tasks_task_id_seq'), tag_id FROM tags WHERE tag_name = ANY($1::text[])
+    ON CONFLICT DO NOTHING
+    RETURNING tag_id)
+    SELECT t.tag_name FROM linked l
+    JOIN tags t ON t.tag_id = l.tag_id
+    ORDER BY l.tag_id)";
+
+// Первоначальная версия createTask: для каждого тега поиск, при необходимости вставка и привязка
+void createPerTag(pqxx::connection& conn, int user_id, const std::vector<std::string>& tags)
+{
+    pqxx::work txn(conn);
+    auto insert = txn.exec_params(
+        "INSERT INTO tasks (user_id, task_name, description, status_id, priority, due_date) "
+        "VALUES ($1, $2, $3, $4, $5, $6) RETURNING task_id",
+        user_id, "bench", "bench", 1, 1, "2099-12-31");
+    int task_id = insert[0][0].as<int>();
+
+    for (const auto& tag_name : tags)
+    {
+        auto tagCheck = txn.exec_params("SELECT tag_id FROM tags WHERE tag_name = $1", tag_name);
+        int tag_id;
+        if (tagCheck.empty())
+            tag_id = txn.exec_params("INSERT INTO tags (tag_name) VALUES ($1) RETURNING tag_id", tag_name)[0][0].as<int>();
+        else
+            tag_id = tagCheck[0][0].as<int>();
+
+        txn.exec_params("INSERT INTO task_tags (task_id, tag_id) VALUES ($1, $2) ON CONFLICT DO NOTHING", task_id, tag_id);
+    }
+
+    txn.commit();
+}
+
+// Транзакция из тех же запросов, что и в pipeline, но с ожиданием ответа на каждый
+void createSequential(pqxx::connection& conn, int user_id, const std::vector<std::string>& tags)
+{
+    pqxx::work txn(conn);
+    txn.exec_params(INSERT_TASK, user_id, "bench", "bench", 1, 1, "2099-12-31");
+    txn.exec_params(INSERT_TAGS, tags);
+    txn.exec_params(LINK_TAGS, tags);
+    txn.commit();
+}
+
+// Те же запросы в режиме pipeline libpq, как в AsyncConnection::pipeline: все запросы с параметрами
+// и Sync уходят подряд, результаты читаются в конце. Запросы до Sync выполняются одной транзакцией
+void createPipelined(PGconn* conn, int user_id, const std::vector<std::string>& tags)
+{
+    std::string user = std::to_string(user_id);
+    std::string tagArray = "{";
+    for (size_t i = 0; i != tags.size(); ++i)
+        tagArray += (i ? ",\"" : "\"") + tags[i] + "\"";
+    tagArray += "}";
+
+    const char* insertParams[] = { user.c_str(), "bench", "bench", "1", "1", "2099-12-31" };
+    const char* linkParams[] = { tagArray.c_str() };
+
+    if (!PQenterPipelineMode(conn)
+        || !PQsendQueryParams(conn, INSERT_TASK.c_str(), 6, nullptr, insertParams, nullptr, nullptr, 0)
+        || !PQsendQueryParams(conn, INSERT_TAGS.c_str(), 1, nullptr, linkParams, nullptr, nullptr, 0)
+        || !PQsendQueryParams(conn, LINK_TAGS.c_str(), 1, nullptr, linkParams, nullptr, nullptr, 0)
+        || !PQpipelineSync(conn))
+        throw std::runtime_error(PQerrorMessage(conn));
+
+    // Результаты каждого запроса заканчиваются NULL, весь pipeline - PGRES_PIPELINE_SYNC
+    std::string error;
+    for (int i = 0; i != 3; ++i)
+        while (PGresult* result = PQgetResult(conn))
+        {
+            if (PQresultStatus(result) != PGRES_TUPLES_OK && PQresultStatus(result) != PGRES_COMMAND_OK && error.empty())
+                error = PQerrorMessage(conn);
+            PQclear(result);
+        }
+
+    PGresult* sync = PQgetResult(conn);
+    PQclear(sync);
+    PQexitPipelineMode(conn);
+    if (!error.empty())
+        throw std::runtime_error(error);
+}
+
+struct Stats
+{
+    double avgMs;
+    double p50Ms;
+    double p99Ms;
+};
+
+Stats measure(const std::function<void()>& create)
+{
+    std::vector<double> times;
+    for (int i = 0; i != ITERATIONS; ++i)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        create();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    std::sort(times.begin(), times.end());
+    double sum = 0;
+    for (double t : times)
+        sum += t;
+
+    return { sum / times.size(), times[times.size() / 2], times[times.size() * 99 / 100] };
+}
+
+// Аргументы: хост и порт Postgres с базой taskManager (по умолчанию localhost 5432)
+int main(int argc, char* argv[])
+{
+    std::string host = argc > 1 ? argv[1] : "localhost";
+    std::string port = argc > 2 ? argv[2] : "5432";
+
+    LatencyProxy proxy(host, port, RTT / 2);
+    std::string connStr = "dbname=taskManager user=postgres password=1234 sslmode=disable host=127.0.0.1 port="
+        + std::to_string(proxy.port());
+    pqxx::connection conn(connStr);
+
+    std::unique_ptr<PGconn, decltype(&PQfinish)> pipelineConn(PQconnectdb(connStr.c_str()), PQfinish);
+    if (PQstatus(pipelineConn.get()) != CONNECTION_OK)
+        throw std::runtime_error(PQerrorMessage(pipelineConn.get()));
+
+    int user_id;
+    {
+        pqxx::work txn(conn);
+        auto user = txn.exec("SELECT user_id FROM users WHERE username = 'pipeline_bench'");
+        if (user.empty())
+            user = txn.exec("INSERT INTO users (username, email, password) "
+                "VALUES ('pipeline_bench', 'pipeline_bench@example.com', '') RETURNING user_id");
+        user_id = user[0][0].as<int>();
+        txn.commit();
+    }
+
+    std::vector<std::string> tags;
+    for (int i = 0; i != TAGS; ++i)
+        tags.push_back("bench_tag_" + std::to_string(i));
+
+    Stats perTag = measure([&] { createPerTag(conn, user_id, tags); });
+    Stats sequential = measure([&] { createSequential(conn, user_id, tags); });
+    Stats pipelined = measure([&] { createPipelined(pipelineConn.get(), user_id, tags); });
+
+    pqxx::nontransaction(conn).exec_params("DELETE FROM tasks WHERE user_id = $1", user_id);
+
+    std::printf("iterations=%d tags=%d rtt=%lldus\n", ITERATIONS, TAGS, (long long)RTT.count());
+    std::printf("%-12s %10s %10s %10s\n", "mode", "avg_ms", "p50_ms", "p99_ms");
+    std::printf("%-12s %10.2f %10.2f %10.2f\n", "per_tag", perTag.avgMs, perTag.p50Ms, perTag.p99Ms);
+    std::printf("%-12s %10.2f %10.2f %10.2f\n", "sequential", sequential.avgMs, sequential.p50Ms, sequential.p99Ms);
+    std::printf("%-12s %10.2f %10.2f %10.2f\n", "pipeline", pipelined.avgMs, pipelined.p50Ms, pipelined.p99Ms);
+    return 0;
+}
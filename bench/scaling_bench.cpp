@@ -0,0 +1,259 @@
+// Бенчмарк масштабирования режима по ядру: сервер запускается с --per-core 1..N, и для каждого
+// числа процессов измеряется количество запросов GET /tasks/<id> в секунду. Нагрузку создают
+// потоки с keep-alive соединениями, каждый отправляет следующий запрос после получения ответа
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int SERVER_PORT = 8080;
+const int STARTUP_TIMEOUT = 30; // Сколько ждать, пока сервер начнет отвечать (сек)
+
+// Клиент HTTP/1.1 с одним keep-alive соединением
+class HttpClient
+{
+public:
+    ~HttpClient() { disconnect(); }
+
+    bool connect()
+    {
+        disconnect();
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(SERVER_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            disconnect();
+            return false;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    // Возвращает код ответа или -1, если соединение разорвано
+    int request(const std::string& method, const std::string& path, const std::string& token,
+        const std::string& body, std::string& responseBody)
+    {
+        if (fd < 0 && !connect())
+            return -1;
+
+        std::string request = method + " " + path + " HTTP/1.1\r\nHost: localhost\r\n";
+        if (!token.empty())
+            request += "Authorization: Bearer " + token + "\r\n";
+        request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+        if (!sendAll(request))
+            return fail();
+
+        // Заголовки читаются до пустой строки, тело - по Content-Length
+        std::string data;
+        size_t headerEnd;
+        while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (!readMore(data))
+                return fail();
+        }
+
+        int code = std::atoi(data.c_str() + data.find(' ') + 1);
+        size_t length = 0;
+        size_t pos = data.find("Content-Length: ");
+        if (pos == std::string::npos)
+            pos = data.find("content-length: ");
+        if (pos != std::string::npos && pos < headerEnd)
+            length = std::strtoul(data.c_str() + pos + 16, nullptr, 10);
+
+        while (data.size() < headerEnd + 4 + length)
+        {
+            if (!readMore(data))
+                return fail();
+        }
+
+        responseBody = data.substr(headerEnd + 4, length);
+        return code;
+    }
+
+private:
+    int fd = -1;
+
+    void disconnect()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+
+    int fail()
+    {
+        disconnect();
+        return -1;
+    }
+
+    bool sendAll(const std::string& data)
+    {
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool readMore(std::string& data)
+    {
+        char buffer[16384];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return false;
+        data.append(buffer, n);
+        return true;
+    }
+};
+
+// Значение поля из плоского JSON ответа сервера
+std::string jsonField(const std::string& json, const std::string& field)
+{
+    size_t pos = json.find("\"" + field + "\"");
+    if (pos == std::string::npos)
+        return "";
+    pos = json.find(':', pos) + 1;
+    while (json[pos] == ' ' || json[pos] == '"')
+        ++pos;
+    size_t end = json.find_first_of("\",}", pos);
+    return json.substr(pos, end - pos);
+}
+
+pid_t startServer(const std::string& binary, int workers)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        std::string count = std::to_string(workers);
+        execl(binary.c_str(), binary.c_str(), "--per-core", count.c_str(), nullptr);
+        _exit(1);
+    }
+    return pid;
+}
+
+// Сервер готов, когда все процессы подняли пулы и отвечают на запросы
+bool waitForServer()
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(STARTUP_TIMEOUT);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        HttpClient client;
+        std::string body;
+        if (client.request("GET", "/tasks", "", "", body) == 401)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    return false;
+}
+
+void stopServer(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+// Аргументы: путь к серверу, максимальное число процессов, длительность замера (сек), число соединений
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s <server binary> [max workers] [seconds] [connections]\n", argv[0]);
+        return 1;
+    }
+
+    std::string binary = argv[1];
+    int maxWorkers = argc > 2 ? std::atoi(argv[2]) : std::thread::hardware_concurrency();
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 10;
+    int connections = argc > 4 ? std::atoi(argv[4]) : 64;
+
+    std::string token;
+    std::string taskPath;
+    double baseline = 0;
+
+    std::printf("connections=%d duration=%ds\n", connections, seconds);
+    std::printf("%-8s %12s %10s %8s\n", "workers", "req_per_sec", "speedup", "errors");
+
+    for (int workers = 1; workers <= maxWorkers; ++workers)
+    {
+        pid_t server = startServer(binary, workers);
+        if (!waitForServer())
+        {
+            std::fprintf(stderr, "Server did not start with %d workers\n", workers);
+            stopServer(server);
+            return 1;
+        }
+
+        // Пользователь и задача создаются один раз, дальше бд и кэш уже содержат их
+        if (token.empty())
+        {
+            HttpClient client;
+            std::string body;
+            std::string credentials = R"({"username":"scaling_bench","email":"scaling_bench@example.com","password":"scaling_bench"})";
+            client.request("POST", "/register", "", credentials, body);
+            client.request("POST", "/login", "", credentials, body);
+            token = jsonField(body, "token");
+            client.request("POST", "/tasks", token, R"({"task_name":"bench","description":"bench"})", body);
+            taskPath = "/tasks/" + jsonField(body, "task_id");
+        }
+
+        std::atomic<bool> running{ true };
+        std::atomic<long long> completed{ 0 };
+        std::atomic<long long> errors{ 0 };
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i != connections; ++i)
+        {
+            threads.emplace_back([&]
+            {
+                HttpClient client;
+                std::string body;
+                while (running.load(std::memory_order_relaxed))
+                {
+                    int code = client.request("GET", taskPath, token, "", body);
+                    if (code == 200)
+                        completed.fetch_add(1, std::memory_order_relaxed);
+                    else
+                        errors.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        running = false;
+        for (auto& thread : threads)
+            thread.join();
+
+        stopServer(server);
+
+        double rate = completed.load() / static_cast<double>(seconds);
+        if (workers == 1)
+            baseline = rate;
+        std::printf("%-8d %12.0f %10.2f %8lld\n", workers, rate, baseline > 0 ? rate / baseline : 0.0, errors.load());
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Бенчмарк лавины промахов кэша: 500 корутин одновременно читают одну задачу, загрузка из бд
+// имитируется таймером и пулом из POOL_SIZE соединений. Все корутины выполняются в одном io_context,
+// как запросы одного рабочего потока сервера
+#include "../src/async_singleflight.h"
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+const int READERS = 500;
+const int POOL_SIZE = 10;
+const auto QUERY_TIME = std::chrono::milliseconds(5);
+
+// Имитация пула соединений к бд. io_context обслуживается одним потоком, поэтому блокировки не нужны
+class FakePool
+{
+public:
+    asio::awaitable<void> acquire()
+    {
+        if (free > 0)
+        {
+            --free;
+            co_return;
+        }
+
+        auto timer = std::make_shared<asio::steady_timer>(co_await asio::this_coro::executor, asio::steady_timer::time_point::max());
+        waiting.push_back(timer);
+        crow::error_code ec;
+        co_await timer->async_wait(asio::redirect_error(asio::use_awaitable, ec)); // Соединение передает release
+    }
+
+    void release()
+    {
+        if (waiting.empty())
+        {
+            ++free;
+            return;
+        }
+        waiting.front()->cancel();
+        waiting.pop_front();
+    }
+
+private:
+    std::deque<std::shared_ptr<asio::steady_timer>> waiting;
+    int free = POOL_SIZE;
+};
+
+struct Result
+{
+    double wallMs;
+    double maxMs;
+    int queries;
+};
+
+Result runStampede(const std::function<asio::awaitable<void>()>& read)
+{
+    asio::io_context io;
+    long long maxNs = 0;
+    auto begin = std::chrono::steady_clock::now();
+
+    for (int i = 0; i != READERS; ++i)
+    {
+        asio::co_spawn(io, [&]() -> asio::awaitable<void>
+        {
+            co_await read();
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            maxNs = std::max(maxNs, ns);
+        }, asio::detached);
+    }
+
+    io.run();
+    auto wall = std::chrono::steady_clock::now() - begin;
+
+    return { std::chrono::duration<double, std::milli>(wall).count(), maxNs / 1e6, 0 };
+}
+
+int main()
+{
+    FakePool pool;
+    int queries = 0;
+
+    auto load = [&]() -> asio::awaitable<std::string>
+    {
+        co_await pool.acquire();
+        asio::steady_timer query(co_await asio::this_coro::executor, QUERY_TIME);
+        co_await query.async_wait(asio::use_awaitable);
+        pool.release();
+        ++queries;
+        co_return std::string(R"({"task_id":1,"task_name":"task","tags":[]})");
+    };
+
+    Result direct = runStampede([&]() -> asio::awaitable<void> { co_await load(); });
+    direct.queries = std::exchange(queries, 0);
+
+    AsyncSingleFlight<std::string> flight;
+    Result coalesced = runStampede([&]() -> asio::awaitable<void> { co_await flight.run("task:1:user:1", load); });
+    coalesced.queries = std::exchange(queries, 0);
+
+    std::printf("readers=%d pool=%d query=%lldms\n", READERS, POOL_SIZE, (long long)QUERY_TIME.count());
+    std::printf("%-12s %10s %12s %12s\n", "mode", "queries", "wall_ms", "max_wait_ms");
+    std::printf("%-12s %10d %12.2f %12.2f\n", "direct", direct.queries, direct.wallMs, direct.maxMs);
+    std::printf("%-12s %10d %12.2f %12.2f\n", "singleflight", coalesced.queries, coalesced.wallMs, coalesced.maxMs);
+    return 0;
+}
@@ -0,0 +1,26 @@
+--
+-- Versions of tasks and task lists for ETag, for databases created from taskManager.sql before they were added.
+-- The script is idempotent: it can be applied to any database, including one that already has the columns
+--
+
+BEGIN;
+
+ALTER TABLE public.tasks ADD COLUMN IF NOT EXISTS version integer DEFAULT 1 NOT NULL;
+
+ALTER TABLE public.users ADD COLUMN IF NOT EXISTS tasks_version bigint DEFAULT 0 NOT NULL;
+
+CREATE OR REPLACE FUNCTION public.update_task_version() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+BEGIN
+    NEW.version = OLD.version + 1;
+    NEW.updated_at = NOW();
+    RETURN NEW;
+END;
+$$;
+
+ALTER FUNCTION public.update_task_version() OWNER TO postgres;
+
+CREATE OR REPLACE TRIGGER update_tasks_version BEFORE UPDATE ON public.tasks FOR EACH ROW EXECUTE FUNCTION public.update_task_version();
+
+COMMIT;
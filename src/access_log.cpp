@@ -0,0 +1,237 @@
+﻿#include "access_log.h"
+#include "debug.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace accesslog
+{
+    namespace
+    {
+        // Путь без id: /tasks/15/comments/3 -> /tasks/{id}/comments/{id}, чтобы записи группировались
+        // по маршруту. Путь копируется уже экранированным для JSON, так как строка журнала собирается
+        // без разбора значений, а кавычка или перевод строки в url сломали бы запись. Не помещающийся
+        // в запись хвост отбрасывается целыми символами, чтобы не разорвать экранирование
+        void normalizeRoute(const std::string& url, char (&route)[ACCESS_LOG_ROUTE_SIZE])
+        {
+            size_t length = 0;
+            bool full = false;
+            auto append = [&](const char* text, size_t size)
+            {
+                for (size_t i = 0; i != size && !full; ++i)
+                {
+                    unsigned char c = text[i];
+                    char escaped[8] = { static_cast<char>(c) };
+                    size_t escapedSize = 1;
+                    if (c == '"' || c == '\\')
+                    {
+                        escaped[0] = '\\';
+                        escaped[1] = static_cast<char>(c);
+                        escapedSize = 2;
+                    }
+                    else if (c < 0x20)
+                        escapedSize = std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+
+                    full = escapedSize > ACCESS_LOG_ROUTE_SIZE - 1 - length;
+                    if (!full)
+                    {
+                        std::memcpy(route + length, escaped, escapedSize);
+                        length += escapedSize;
+                    }
+                }
+            };
+
+            size_t pos = 0;
+            while (pos < url.size())
+            {
+                size_t end = url.find('/', pos + 1);
+                if (end == std::string::npos)
+                    end = url.size();
+
+                bool numeric = end > pos + 1;
+                for (size_t i = pos + 1; i < end && numeric; ++i)
+                    numeric = url[i] >= '0' && url[i] <= '9';
+
+                if (numeric)
+                    append("/{id}", 5);
+                else
+                    append(url.data() + pos, end - pos);
+                pos = end;
+            }
+            route[length] = '\0';
+        }
+
+        // Маршрут для сводки выделений. Ключ сводки живет до сброса, поэтому берется только из постоянного
+        // списка маршрутов сервера: иначе произвольные пути (/x1, /x2, ...) раздували бы таблицу без предела.
+        // Ненайденные маршруты и ответы 404 попадают в одну запись unmatched
+        const char* statsRoute(const char* route, int status)
+        {
+            static const char* const routes[] = {
+                "/register", "/login", "/tasks", "/tasks/{id}", "/tasks/{id}/tags", "/tasks/{id}/comments",
+                "/tasks/{id}/comments/{id}", "/debug/profile", "/debug/allocations", "/debug/redis", "/debug/admission"
+            };
+
+            if (status != 404)
+                for (const char* known : routes)
+                    if (std::strcmp(route, known) == 0)
+                        return known;
+            return "unmatched";
+        }
+    }
+
+    Writer::Writer() : ring(ACCESS_LOG_CAPACITY), droppedEntries(0)
+    {
+        std::thread([this] { run(); }).detach();
+    }
+
+    Writer& Writer::getInstance()
+    {
+        static Writer writer;
+        return writer;
+    }
+
+    void Writer::submit(const Entry& entry)
+    {
+        if (!ring.push(entry))
+            droppedEntries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    unsigned long long Writer::dropped() const
+    {
+        return droppedEntries.load(std::memory_order_relaxed);
+    }
+
+    // Буфер вычитывается пакетами до ACCESS_LOG_BATCH записей, пакет уходит в файл одним fwrite.
+    // Число отброшенных записей пишется отдельной строкой, когда оно меняется
+    void Writer::run()
+    {
+        FILE* file = std::fopen(ACCESS_LOG_FILE.c_str(), "a");
+        if (!file)
+        {
+            CROW_LOG_ERROR << "Cannot open " << ACCESS_LOG_FILE << ", access log is discarded";
+            return;
+        }
+
+        std::string batch;
+        unsigned long long reportedDrops = 0;
+        Entry entry;
+        while (true)
+        {
+            batch.clear();
+            size_t count = 0;
+            while (count != ACCESS_LOG_BATCH && ring.pop(entry))
+            {
+                char line[256];
+                int size = std::snprintf(line, sizeof(line),
+                    R"({"time":%lld,"method":"%s","route":"%s","status":%d,"user_id":%d,"duration_us":%lld,"bytes":%zu,)"
+                    R"("allocs":%lld,"alloc_bytes":%lld})" "\n",
+                    entry.time, crow::method_name(entry.method).c_str(), entry.route, entry.status, entry.user_id,
+                    entry.durationUs, entry.bytes, entry.allocations, entry.allocatedBytes);
+                batch.append(line, std::min<size_t>(size, sizeof(line) - 1));
+                ++count;
+            }
+
+            unsigned long long drops = dropped();
+            if (drops != reportedDrops)
+            {
+                batch += R"({"dropped":)" + std::to_string(drops) + "}\n";
+                reportedDrops = drops;
+            }
+
+            if (!batch.empty())
+            {
+                std::fwrite(batch.data(), 1, batch.size(), file);
+                std::fflush(file);
+            }
+
+            // Неполный пакет значит, что буфер опустел
+            if (count != ACCESS_LOG_BATCH)
+                std::this_thread::sleep_for(std::chrono::milliseconds(ACCESS_LOG_FLUSH_INTERVAL_MS));
+        }
+    }
+
+    // Контекст промежуточного слоя лежит в запросе. Запрос без него (например, в бенчмарках) пропускается
+    void setUser(const crow::request& req, int user_id)
+    {
+        if (req.middleware_context)
+            static_cast<App::context_t*>(req.middleware_context)->get<AccessLogMiddleware>().user_id = user_id;
+    }
+
+    std::shared_ptr<allocstats::Counters> allocationCounters(const crow::request& req)
+    {
+        if (!req.middleware_context)
+            return nullptr;
+        return static_cast<App::context_t*>(req.middleware_context)->get<AccessLogMiddleware>().allocations;
+    }
+
+    std::shared_ptr<deadline::Deadline> requestDeadline(const crow::request& req)
+    {
+        if (!req.middleware_context)
+            return nullptr;
+        return static_cast<App::context_t*>(req.middleware_context)->get<AccessLogMiddleware>().deadline;
+    }
+
+    int user(const crow::request& req)
+    {
+        if (!req.middleware_context)
+            return 0;
+        return static_cast<App::context_t*>(req.middleware_context)->get<AccessLogMiddleware>().user_id;
+    }
+}
+
+void AccessLogMiddleware::before_handle(crow::request& req, crow::response& res, context& ctx)
+{
+    ctx.start = std::chrono::steady_clock::now();
+    ctx.time = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Синхронная часть обработчика считается здесь, корутина - своим исполнителем (runAsync)
+    ctx.allocations = std::make_shared<allocstats::Counters>();
+    allocstats::current = ctx.allocations.get();
+    ctx.deadline = deadline::create(req, res);
+    deadline::current = ctx.deadline.get();
+}
+
+// Для запроса без подходящего маршрута Crow не вызывает before_handle, такой запрос пишется с нулевой длительностью
+void AccessLogMiddleware::after_handle(crow::request& req, crow::response& res, context& ctx)
+{
+    if (ctx.time == 0)
+        before_handle(req, res, ctx);
+
+    // Обработчик, прерванный по сроку, мог ответить чем угодно, клиент получает 504. Ответ
+    // отправляется после этого вызова, а проверять соединение после него уже нельзя
+    deadline::current = nullptr;
+    ctx.deadline->clientGone = nullptr;
+    if (ctx.deadline->exceeded)
+    {
+        res.code = 504;
+        res.body = deadline::Expired().what();
+    }
+
+    accesslog::Entry entry;
+    entry.time = ctx.time;
+    entry.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - ctx.start).count();
+    entry.method = req.method;
+    entry.status = res.code;
+    entry.user_id = ctx.user_id;
+    entry.bytes = res.body.size();
+    accesslog::normalizeRoute(req.url, entry.route);
+
+    // Запись сводки сама выделяет память, поэтому счет запроса заканчивается до нее
+    allocstats::current = nullptr;
+    const allocstats::Counters& allocations = *ctx.allocations;
+    entry.allocations = allocations.allocations;
+    entry.allocatedBytes = allocations.bytes;
+    allocstats::record(crow::method_name(req.method) + " " + accesslog::statsRoute(entry.route, res.code), allocations);
+
+    // Бюджеты выделений в тестах проверяются по этим заголовкам
+    if (debug::checkDebugToken(req))
+    {
+        res.set_header("X-Alloc-Count", std::to_string(allocations.allocations));
+        res.set_header("X-Alloc-Bytes", std::to_string(allocations.bytes));
+        res.set_header("X-Alloc-Peak", std::to_string(allocations.peak));
+    }
+
+    accesslog::Writer::getInstance().submit(entry);
+}
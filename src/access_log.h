@@ -0,0 +1,149 @@
+﻿#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include "crow_all.h"
+#include "admission.h"
+#include "alloc_stats.h"
+#include "deadline.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+const size_t ACCESS_LOG_CAPACITY = 65536; // Записей в кольцевом буфере, степень двойки
+const size_t ACCESS_LOG_BATCH = 1024; // Сколько записей уходит в файл одной записью
+const int ACCESS_LOG_FLUSH_INTERVAL_MS = 100; // Пауза потока записи, когда буфер пуст
+const std::string ACCESS_LOG_FILE = "access.log"; // Журнал запросов, по строке JSON на запрос
+const size_t ACCESS_LOG_ROUTE_SIZE = 64; // Длина маршрута в записи, длиннее обрезается
+
+// Ограниченная очередь многих производителей и одного потребителя без блокировок (схема Вьюкова):
+// у каждой ячейки есть номер, по которому производитель видит, что ячейка свободна, а потребитель -
+// что она заполнена. Производитель занимает позицию одним CAS и никогда не ждет: если очередь
+// полна, push возвращает false
+template <typename T>
+class MpscRing
+{
+public:
+    explicit MpscRing(size_t capacity) : mask(capacity - 1), slots(new Slot[capacity]), head(0), tail(0)
+    {
+        for (size_t i = 0; i != capacity; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const T& value)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot& slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = value;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false; // Потребитель еще не освободил ячейку круг назад
+            else
+                pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Вызывается только из одного потока
+    bool pop(T& value)
+    {
+        Slot& slot = slots[tail & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != tail + 1)
+            return false;
+
+        value = slot.value;
+        slot.sequence.store(tail + mask + 1, std::memory_order_release);
+        ++tail;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> head; // Производители и потребитель на разных строках кэша
+    alignas(64) size_t tail;
+};
+
+namespace accesslog
+{
+    // Запись фиксированного размера, чтобы запрос не выделял память ради журнала
+    struct Entry
+    {
+        long long time = 0; // Unix-время начала запроса в микросекундах
+        long long durationUs = 0; // От получения запроса до отправки ответа
+        crow::HTTPMethod method = crow::HTTPMethod::Get;
+        int status = 0;
+        int user_id = 0; // 0 - запрос без действительного токена
+        size_t bytes = 0; // Размер тела ответа
+        long long allocations = 0; // Выделений памяти за запрос
+        long long allocatedBytes = 0;
+        char route[ACCESS_LOG_ROUTE_SIZE] = {}; // Путь, в котором числовые сегменты заменены на {id}
+    };
+
+    // Запись журнала в фоновом потоке пакетами. Потоки запросов только кладут запись в кольцевой
+    // буфер; если он полон, запись отбрасывается и учитывается в dropped
+    class Writer
+    {
+    public:
+        static Writer& getInstance();
+        void submit(const Entry& entry);
+        unsigned long long dropped() const;
+
+    private:
+        Writer();
+
+        MpscRing<Entry> ring;
+        std::atomic<unsigned long long> droppedEntries;
+
+        void run();
+    };
+
+    // Пользователь запроса для журнала, вызывается после проверки токена
+    void setUser(const crow::request& req, int user_id);
+
+    // Счетчики выделений запроса, nullptr для запроса без промежуточного слоя
+    std::shared_ptr<allocstats::Counters> allocationCounters(const crow::request& req);
+    std::shared_ptr<deadline::Deadline> requestDeadline(const crow::request& req);
+    int user(const crow::request& req); // 0, если токен запроса еще не проверен или неверен
+}
+
+// Промежуточный слой Crow: замеряет запрос и передает запись в журнал, когда ответ отправлен
+// (для корутин это происходит при res.end, а не при возврате из обработчика). Он же ведет учет
+// выделений памяти запроса, срок запроса и сводку по маршрутам
+struct AccessLogMiddleware
+{
+    struct context
+    {
+        std::chrono::steady_clock::time_point start;
+        long long time = 0;
+        int user_id = 0;
+        std::shared_ptr<allocstats::Counters> allocations;
+        std::shared_ptr<deadline::Deadline> deadline;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+// Промежуточные слои вызываются по порядку, а после обработки - в обратном
+using App = crow::App<AccessLogMiddleware, AdmissionMiddleware>;
+
+#endif
@@ -0,0 +1,205 @@
+﻿#include "admission.h"
+#include "auth.h"
+#include "fairness.h"
+#include "rate_limit.h"
+#include <algorithm>
+#include <cmath>
+
+namespace admission
+{
+    // Вход и регистрация считают хеш пароля и дороже остальных, чтение и запись расходуют разные
+    // ресурсы бд, поэтому у каждого класса свой предел. Отладочные маршруты не ограничиваются
+    RouteClass classify(const crow::request& req)
+    {
+        if (req.url == "/login" || req.url == "/register")
+            return RouteClass::Auth;
+        if (req.url.rfind("/debug/", 0) == 0)
+            return RouteClass::None;
+        if (req.method == crow::HTTPMethod::Get || req.method == crow::HTTPMethod::Head)
+            return RouteClass::Read;
+        return RouteClass::Write;
+    }
+
+    const char* className(RouteClass routeClass)
+    {
+        switch (routeClass)
+        {
+        case RouteClass::Auth:
+            return "auth";
+        case RouteClass::Read:
+            return "read";
+        case RouteClass::Write:
+            return "write";
+        default:
+            return "none";
+        }
+    }
+
+    Limiter::Limiter()
+        : inflight(0), limit(ADMISSION_INITIAL_LIMIT), accepted(0), rejected(0), estimatedLimit(ADMISSION_INITIAL_LIMIT),
+        shortRtt(0), longRtt(0), windowSum(0), windowSamples(0), windowMaxInflight(0),
+        probeAt(std::chrono::steady_clock::now() + std::chrono::milliseconds(ADMISSION_PROBE_INTERVAL_MS)), probeWindows(0) {}
+
+    // Без блокировок: место занимается CAS, пока число запросов меньше предела
+    bool Limiter::tryAcquire()
+    {
+        int current = inflight.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (current >= limit.load(std::memory_order_relaxed))
+            {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (inflight.compare_exchange_weak(current, current + 1, std::memory_order_relaxed))
+            {
+                accepted.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    void Limiter::release(std::chrono::steady_clock::duration latency)
+    {
+        int current = inflight.fetch_sub(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        windowSum += std::chrono::duration<double, std::micro>(latency).count();
+        windowMaxInflight = std::max(windowMaxInflight, current);
+        if (++windowSamples >= ADMISSION_WINDOW_SAMPLES)
+            update();
+    }
+
+    // Пересчет предела по окну, вызывается под mtx
+    void Limiter::update()
+    {
+        shortRtt = windowSum / windowSamples;
+        int maxInflight = windowMaxInflight;
+        windowSum = 0;
+        windowSamples = 0;
+        windowMaxInflight = 0;
+
+        // Задержка без очереди - наименьшая задержка окна. Если сервер перегружен с самого начала или
+        // запросы стали дороже (например, выросла таблица), наименьшая задержка устаревает, поэтому раз
+        // в ADMISSION_PROBE_INTERVAL_MS предел на ADMISSION_PROBE_WINDOWS окон уменьшается вдвое:
+        // очереди за первое окно рассасываются, а последнее окно дает новую задержку без очереди
+        auto now = std::chrono::steady_clock::now();
+        if (probeWindows > 0)
+        {
+            if (--probeWindows == 0)
+            {
+                longRtt = shortRtt;
+                limit.store(static_cast<int>(estimatedLimit), std::memory_order_relaxed);
+            }
+            return;
+        }
+        if (now >= probeAt && longRtt != 0)
+        {
+            probeAt = now + std::chrono::milliseconds(ADMISSION_PROBE_INTERVAL_MS);
+            probeWindows = ADMISSION_PROBE_WINDOWS;
+            limit.store(std::max(ADMISSION_MIN_LIMIT, static_cast<int>(estimatedLimit / 2)), std::memory_order_relaxed);
+            return;
+        }
+        if (longRtt == 0 || shortRtt < longRtt)
+            longRtt = shortRtt;
+
+        // Предел не используется и наполовину: задержка ничего не говорит о том, сколько запросов выдержит сервер
+        if (maxInflight < estimatedLimit / 2)
+            return;
+
+        double gradient = std::clamp(ADMISSION_RTT_TOLERANCE * longRtt / shortRtt, 0.5, 1.0);
+        double newLimit = estimatedLimit * gradient + std::sqrt(estimatedLimit);
+        estimatedLimit = std::clamp(estimatedLimit * (1 - ADMISSION_SMOOTHING) + newLimit * ADMISSION_SMOOTHING,
+            double(ADMISSION_MIN_LIMIT), double(ADMISSION_MAX_LIMIT));
+        limit.store(static_cast<int>(estimatedLimit), std::memory_order_relaxed);
+    }
+
+    Limiter::Stats Limiter::stats()
+    {
+        Stats result;
+        result.limit = limit.load(std::memory_order_relaxed);
+        result.inflight = inflight.load(std::memory_order_relaxed);
+        result.accepted = accepted.load(std::memory_order_relaxed);
+        result.rejected = rejected.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mtx);
+        result.shortRttMs = shortRtt / 1000;
+        result.longRttMs = longRtt / 1000;
+        return result;
+    }
+
+    Limiter& limiter(RouteClass routeClass)
+    {
+        static Limiter limiters[3];
+        return limiters[static_cast<int>(routeClass)];
+    }
+}
+
+// Сначала проверяются частота запросов и предел пользователя, затем предел класса маршрута: запросы
+// пользователя сверх его пределов не занимают место других пользователей в пределе класса
+void AdmissionMiddleware::before_handle(crow::request& req, crow::response& res, context& ctx)
+{
+    admission::RouteClass routeClass = admission::classify(req);
+    if (routeClass == admission::RouteClass::None)
+        return;
+
+    // Токен проверяется здесь один раз, обработчик берет пользователя из контекста запроса.
+    // Запрос с неверным токеном проходит дальше, и обработчик отвечает на него 401
+    int user_id = 0;
+    bool authorized = routeClass != admission::RouteClass::Auth && auth::checkToken(req, user_id);
+
+    // Частота входов ограничивается по IP, частота изменений - по пользователю, а без токена тоже по IP
+    int retryAfter = 0;
+    auto& rateLimiter = ratelimit::Limiter::getInstance();
+    if (routeClass == admission::RouteClass::Auth)
+        retryAfter = rateLimiter.tryConsume("auth:ip:" + req.remote_ip_address, ratelimit::AUTH_LIMIT);
+    else if (routeClass == admission::RouteClass::Write)
+        retryAfter = rateLimiter.tryConsume(authorized ? "write:user:" + std::to_string(user_id)
+            : "write:ip:" + req.remote_ip_address, ratelimit::WRITE_LIMIT);
+    if (retryAfter)
+    {
+        res.code = 429;
+        res.body = "Too many requests";
+        res.set_header("Retry-After", std::to_string(retryAfter));
+        res.end();
+        return;
+    }
+
+    if (authorized)
+    {
+        if (!fairness::userCounters().tryAcquire(user_id, USER_MAX_CONCURRENT))
+        {
+            res.code = 429;
+            res.body = "Too many concurrent requests";
+            res.set_header("Retry-After", std::to_string(USER_RETRY_AFTER_SECONDS));
+            res.end();
+            return;
+        }
+        ctx.user_id = user_id;
+        fairness::currentUser = user_id;
+    }
+
+    admission::Limiter& limiter = admission::limiter(routeClass);
+    if (!limiter.tryAcquire())
+    {
+        res.code = 503;
+        res.body = "Server is overloaded";
+        res.set_header("Retry-After", std::to_string(ADMISSION_RETRY_AFTER_SECONDS));
+        res.end();
+        return;
+    }
+
+    ctx.limiter = &limiter;
+    ctx.start = std::chrono::steady_clock::now();
+}
+
+// Для асинхронного обработчика вызывается, когда корутина отправляет ответ, поэтому задержка полная
+void AdmissionMiddleware::after_handle(crow::request& /* req */, crow::response& /* res */, context& ctx)
+{
+    if (ctx.limiter)
+        ctx.limiter->release(std::chrono::steady_clock::now() - ctx.start);
+    if (ctx.user_id)
+        fairness::userCounters().release(ctx.user_id);
+    ctx.limiter = nullptr;
+    ctx.user_id = 0;
+    fairness::currentUser = 0;
+}
@@ -0,0 +1,89 @@
+﻿#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "crow_all.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+const int ADMISSION_INITIAL_LIMIT = 64; // Одновременных запросов класса до первых замеров
+const int ADMISSION_MIN_LIMIT = 4;
+const int ADMISSION_MAX_LIMIT = 2000;
+const int ADMISSION_WINDOW_SAMPLES = 64; // Запросов в окне, по которому пересчитывается предел
+const int ADMISSION_PROBE_INTERVAL_MS = 10000; // Как часто заново измеряется задержка без очереди
+const int ADMISSION_PROBE_WINDOWS = 2; // Окон с уменьшенным пределом на одно измерение
+const double ADMISSION_RTT_TOLERANCE = 1.5; // Во сколько раз задержка может превысить обычную, прежде чем предел начнет уменьшаться
+const double ADMISSION_SMOOTHING = 0.2; // Доля нового значения предела при пересчете
+const int ADMISSION_RETRY_AFTER_SECONDS = 1;
+
+// Адаптивное ограничение числа одновременных запросов (схема Gradient). Задержка запросов в окне
+// сравнивается с задержкой без очереди: ее рост означает, что запросы стоят в очередях (потоки,
+// пулы соединений, бд), и предел уменьшается пропорционально, а пока задержка обычная, предел растет
+// на корень из себя. Запрос сверх предела сразу получает 503, а не ждет в общей очереди, поэтому
+// принятые запросы выполняются с обычной задержкой
+namespace admission
+{
+    enum class RouteClass { Auth, Read, Write, None };
+
+    RouteClass classify(const crow::request& req);
+    const char* className(RouteClass routeClass);
+
+    class Limiter
+    {
+    public:
+        Limiter();
+
+        bool tryAcquire(); // false - запрос нужно отклонить
+        void release(std::chrono::steady_clock::duration latency);
+
+        struct Stats
+        {
+            int limit;
+            int inflight;
+            long long accepted;
+            long long rejected;
+            double shortRttMs; // Средняя задержка последнего окна
+            double longRttMs; // Задержка без очереди, к которой сводится предел
+        };
+
+        Stats stats();
+
+    private:
+        std::atomic<int> inflight;
+        std::atomic<int> limit;
+        std::atomic<long long> accepted;
+        std::atomic<long long> rejected;
+
+        std::mutex mtx; // Защищает окно и оценки ниже, берется только при завершении запроса
+        double estimatedLimit;
+        double shortRtt; // мкс
+        double longRtt; // мкс, задержка без очереди
+        double windowSum;
+        int windowSamples;
+        int windowMaxInflight;
+        std::chrono::steady_clock::time_point probeAt; // Когда заново измерить задержку без очереди
+        int probeWindows; // Сколько окон измерения осталось, 0 - измерения нет
+
+        void update();
+    };
+
+    Limiter& limiter(RouteClass routeClass);
+}
+
+// Отклоняет запросы сверх частоты или предела пользователя (429) и сверх предела класса маршрута (503). Стоит
+// после AccessLogMiddleware, поэтому отклоненные запросы тоже попадают в журнал
+struct AdmissionMiddleware
+{
+    struct context
+    {
+        admission::Limiter* limiter = nullptr; // Запрос принят и учтен в пределе
+        int user_id = 0; // Запрос учтен в пределе этого пользователя
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+#endif
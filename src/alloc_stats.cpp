@@ -0,0 +1,109 @@
+﻿#include "alloc_stats.h"
+#include "profiler.h"
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace allocstats
+{
+    namespace
+    {
+        struct ThreadTable
+        {
+            std::mutex mtx; // Берет поток-владелец и изредка отладочный маршрут
+            std::unordered_map<std::string, RouteStats> routes;
+        };
+
+        std::mutex registryMtx;
+        std::vector<std::shared_ptr<ThreadTable>> tables;
+
+        ThreadTable& threadTable()
+        {
+            thread_local std::shared_ptr<ThreadTable> table = []
+            {
+                auto created = std::make_shared<ThreadTable>();
+                std::lock_guard<std::mutex> lock(registryMtx);
+                tables.push_back(created);
+                return created;
+            }();
+            return *table;
+        }
+    }
+
+    void record(const std::string& route, const Counters& counters)
+    {
+        ThreadTable& table = threadTable();
+        std::lock_guard<std::mutex> lock(table.mtx);
+        RouteStats& stats = table.routes[route];
+        ++stats.requests;
+        stats.allocations += counters.allocations;
+        stats.bytes += counters.bytes;
+        stats.maxAllocations = std::max(stats.maxAllocations, counters.allocations);
+        stats.maxBytes = std::max(stats.maxBytes, counters.bytes);
+        stats.maxPeak = std::max(stats.maxPeak, counters.peak);
+    }
+
+    std::unordered_map<std::string, RouteStats> routes()
+    {
+        std::unordered_map<std::string, RouteStats> merged;
+        std::lock_guard<std::mutex> registryLock(registryMtx);
+        for (const auto& table : tables)
+        {
+            std::lock_guard<std::mutex> lock(table->mtx);
+            for (const auto& [route, stats] : table->routes)
+            {
+                RouteStats& total = merged[route];
+                total.requests += stats.requests;
+                total.allocations += stats.allocations;
+                total.bytes += stats.bytes;
+                total.maxAllocations = std::max(total.maxAllocations, stats.maxAllocations);
+                total.maxBytes = std::max(total.maxBytes, stats.maxBytes);
+                total.maxPeak = std::max(total.maxPeak, stats.maxPeak);
+            }
+        }
+        return merged;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> registryLock(registryMtx);
+        for (const auto& table : tables)
+        {
+            std::lock_guard<std::mutex> lock(table->mtx);
+            table->routes.clear();
+        }
+    }
+}
+
+// Вне запроса (current == nullptr) выделение стоит одной проверки сверх malloc
+void* operator new(size_t size)
+{
+    profiler::sampleAllocation(size);
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    if (allocstats::Counters* counters = allocstats::current)
+    {
+        ++counters->allocations;
+        counters->bytes += size;
+        counters->live += malloc_usable_size(ptr);
+        counters->peak = std::max(counters->peak, counters->live);
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (allocstats::Counters* counters = allocstats::current; counters && ptr)
+    {
+        ++counters->frees;
+        counters->live -= malloc_usable_size(ptr);
+    }
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
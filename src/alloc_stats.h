@@ -0,0 +1,44 @@
+﻿#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Учет выделений памяти по запросам. Замещенные operator new/delete прибавляют выделение к счетчикам
+// текущего запроса потока (current). Синхронный участок запроса выставляет current сам, а корутина
+// запроса запускается на RequestExecutor, который выставляет current на время каждого своего
+// продолжения, поэтому выделения корутин, чередующихся в одном потоке, не смешиваются
+namespace allocstats
+{
+    struct Counters
+    {
+        long long allocations = 0;
+        long long frees = 0;
+        long long bytes = 0; // Запрошено байт
+        long long live = 0; // Занято сейчас (по malloc_usable_size), может уйти в минус из-за чужих освобождений
+        long long peak = 0; // Наибольшее значение live
+    };
+
+    inline thread_local Counters* current = nullptr;
+
+    // Сводка по маршрутам: средние за запрос и наибольшие значения
+    struct RouteStats
+    {
+        long long requests = 0;
+        long long allocations = 0;
+        long long bytes = 0;
+        long long maxAllocations = 0;
+        long long maxBytes = 0;
+        long long maxPeak = 0;
+    };
+
+    // Учет завершенного запроса. Таблица у каждого потока своя, поэтому потоки не соперничают
+    void record(const std::string& route, const Counters& counters);
+    std::unordered_map<std::string, RouteStats> routes();
+    void reset();
+}
+
+#endif
@@ -0,0 +1,39 @@
+﻿#include "arena.h"
+#include <vector>
+
+namespace
+{
+    // Свободные блоки текущего потока. Корутины запросов одного потока чередуются, поэтому
+    // у каждой арены свой блок, а не один общий буфер потока
+    std::vector<std::unique_ptr<std::byte[]>>& freeBlocks()
+    {
+        thread_local std::vector<std::unique_ptr<std::byte[]>> blocks;
+        return blocks;
+    }
+
+    std::unique_ptr<std::byte[]> takeBlock()
+    {
+        auto& blocks = freeBlocks();
+        if (blocks.empty())
+            return std::make_unique<std::byte[]>(REQUEST_ARENA_SIZE);
+
+        auto block = std::move(blocks.back());
+        blocks.pop_back();
+        return block;
+    }
+}
+
+RequestArena::RequestArena()
+    : block(takeBlock()), pool(block.get(), REQUEST_ARENA_SIZE, std::pmr::new_delete_resource())
+{
+}
+
+// Дополнительные блоки, выделенные при росте, возвращаются в кучу, начальный блок - потоку
+RequestArena::~RequestArena()
+{
+    pool.release();
+
+    auto& blocks = freeBlocks();
+    if (blocks.size() < REQUEST_ARENA_CACHED_BLOCKS)
+        blocks.push_back(std::move(block));
+}
@@ -0,0 +1,30 @@
+﻿#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+const size_t REQUEST_ARENA_SIZE = 64 * 1024; // Начальный блок арены, его хватает на список из ~200 задач
+const size_t REQUEST_ARENA_CACHED_BLOCKS = 16; // Сколько свободных блоков хранит каждый поток
+
+// Арена одного запроса: все временные строки и векторы запроса берутся из одного блока и
+// освобождаются разом в конце запроса. Блоки переиспользуются потоком, поэтому в обычном
+// случае запрос не обращается к malloc, а при большом ответе арена растет геометрически
+class RequestArena
+{
+public:
+    RequestArena();
+    ~RequestArena();
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &pool; }
+
+private:
+    std::unique_ptr<std::byte[]> block;
+    std::pmr::monotonic_buffer_resource pool;
+};
+
+#endif
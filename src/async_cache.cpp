@@ -0,0 +1,286 @@
+﻿#include "async_cache.h"
+
+AsyncRedisConnection::AsyncRedisConnection(asio::any_io_executor executor) : ctx(nullptr), socket(executor), waits(0) {}
+
+AsyncRedisConnection::~AsyncRedisConnection()
+{
+    close();
+}
+
+void AsyncRedisConnection::close()
+{
+    if (socket.is_open())
+        socket.release();
+    if (ctx)
+        redisFree(ctx);
+    ctx = nullptr;
+}
+
+// Ожидание готовности сокета не дольше timeoutMs: по таймеру ожидание отменяется, и
+// корутина получает исключение. Таймер держит только слабую ссылку, соединение может быть уже удалено
+asio::awaitable<void> AsyncRedisConnection::wait(asio::posix::stream_descriptor::wait_type type, int timeoutMs)
+{
+    unsigned long long id = ++waits;
+    asio::steady_timer timer(socket.get_executor(), std::chrono::milliseconds(timeoutMs));
+    timer.async_wait([self = weak_from_this(), id](const crow::error_code& ec)
+        {
+            auto conn = self.lock();
+            if (!ec && conn && conn->waits == id && conn->socket.is_open())
+                conn->socket.cancel();
+        });
+    co_await socket.async_wait(type, asio::use_awaitable);
+}
+
+// Подключение без блокировки потока: ждем, пока сокет станет доступен для записи
+asio::awaitable<void> AsyncRedisConnection::connect(const std::string& host, int port)
+{
+    ctx = redisConnectNonBlock(host.c_str(), port);
+    if (!ctx || ctx->err)
+        throw std::runtime_error(ctx ? ctx->errstr : "Out of memory");
+
+    socket.assign(ctx->fd);
+    co_await wait(asio::posix::stream_descriptor::wait_write, REDIS_CONNECT_TIMEOUT_MS);
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(ctx->fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0)
+        throw std::runtime_error("Redis connection failed");
+}
+
+// Выполнение команды, аргументы передаются без форматирования, поэтому могут содержать любые байты.
+// Массивы указателей и длин для hiredis собираются в буфере на кадре корутины
+asio::awaitable<RedisReplyPtr> AsyncRedisConnection::command(std::span<const std::string_view> args)
+{
+    {
+        std::byte buffer[512];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+        std::pmr::vector<const char*> argv(&arena);
+        std::pmr::vector<size_t> argvlen(&arena);
+        argv.reserve(args.size());
+        argvlen.reserve(args.size());
+        for (const auto& arg : args)
+        {
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+
+        if (redisAppendCommandArgv(ctx, argv.size(), argv.data(), argvlen.data()) != REDIS_OK)
+            throw std::runtime_error(ctx->errstr);
+    }
+
+    try
+    {
+        int done = 0;
+        while (true)
+        {
+            if (redisBufferWrite(ctx, &done) != REDIS_OK)
+                throw std::runtime_error(ctx->errstr);
+            if (done)
+                break;
+            co_await wait(asio::posix::stream_descriptor::wait_write, REDIS_COMMAND_TIMEOUT_MS);
+        }
+
+        void* reply = nullptr;
+        while (true)
+        {
+            if (redisGetReplyFromReader(ctx, &reply) != REDIS_OK)
+                throw std::runtime_error(ctx->errstr);
+            if (reply)
+                break;
+
+            co_await wait(asio::posix::stream_descriptor::wait_read, REDIS_COMMAND_TIMEOUT_MS);
+            if (redisBufferRead(ctx) != REDIS_OK)
+                throw std::runtime_error(ctx->errstr);
+        }
+
+        co_return RedisReplyPtr(static_cast<redisReply*>(reply));
+    }
+    catch (...)
+    {
+        // Ответ не дочитан, соединение больше нельзя использовать
+        close();
+        throw;
+    }
+}
+
+bool AsyncRedisConnection::isOpen() const
+{
+    return ctx && !ctx->err;
+}
+
+// Пул неблокирующих соединений с Redis текущего рабочего потока
+AsyncPool<AsyncRedisConnection>& asyncRedisPool()
+{
+    thread_local AsyncPool<AsyncRedisConnection> pool(ASYNC_REDIS_POOL_SIZE,
+        [](asio::any_io_executor executor) -> asio::awaitable<std::shared_ptr<AsyncRedisConnection>>
+        {
+            auto conn = std::make_shared<AsyncRedisConnection>(executor);
+            co_await conn->connect(HOST, PORT);
+            co_return conn;
+        });
+    return pool;
+}
+
+// Команда на соединении из пула. Кэш не обязателен для работы, поэтому при недоступном Redis
+// возвращается пустой ответ, как и в синхронных функциях кэша. Пока автомат защиты открыт
+// или срок запроса истек, к Redis не обращаемся вовсе
+asio::awaitable<RedisReplyPtr> redisCommandAsync(std::span<const std::string_view> args)
+{
+    auto& breaker = redisCircuitBreaker();
+    if (deadline::expired() || !breaker.allow())
+        co_return RedisReplyPtr();
+
+    RedisReplyPtr reply;
+    try
+    {
+        auto& pool = asyncRedisPool();
+        AsyncPoolGuard<AsyncRedisConnection> redis(pool, co_await pool.acquire());
+        reply = co_await redis->command(args);
+    }
+    catch (const deadline::Expired&)
+    {
+        co_return RedisReplyPtr(); // Срок истек в ожидании соединения, Redis тут ни при чем
+    }
+    catch (const std::exception&)
+    {
+        breaker.failure();
+        co_return RedisReplyPtr();
+    }
+
+    breaker.success();
+    co_return reply;
+}
+
+asio::awaitable<CachedTask> getTaskFromCacheAsync(int task_id, int user_id)
+{
+    CachedTask cached;
+    std::string key = createCacheKey(task_id, user_id);
+    std::array<std::string_view, 2> args{ "GET", key };
+    auto reply = co_await redisCommandAsync(args);
+    if (reply && reply->type == REDIS_REPLY_STRING)
+        cached = parseCachedTask(std::string_view(reply->str, reply->len));
+    co_return cached;
+}
+
+// Запись для кэша собирается на арене вызывающего, тело задачи не копируется лишний раз
+asio::awaitable<void> saveTaskInCacheAsync(int task_id, int user_id, std::string_view body, std::string_view etag,
+    std::pmr::memory_resource* resource)
+{
+    std::string key = createCacheKey(task_id, user_id);
+    std::string ttl = std::to_string(TASK_CACHE_TTL + TASK_CACHE_STALE_TTL);
+    std::pmr::string value = cachedTaskValue(etag, body, resource);
+    std::array<std::string_view, 4> args{ "SETEX", key, ttl, value };
+    co_await redisCommandAsync(args);
+}
+
+// Изменение полей задачи в кэше без повторной сборки из бд. Запись меняется, только если в кэше
+// лежит предыдущая версия задачи, иначе она удаляется, чтобы следующее чтение взяло данные из бд
+asio::awaitable<void> patchTaskInCacheAsync(int task_id, int user_id, const std::string& previousEtag, const std::string& etag,
+    const crow::json::wvalue& fields)
+{
+    CachedTask cached = co_await getTaskFromCacheAsync(task_id, user_id);
+    if (cached.etag == etag)
+        co_return; // Новую версию уже записало чтение задачи
+
+    if (cached.body.empty() || cached.etag != previousEtag)
+    {
+        co_await deleteTaskFromCacheAsync(task_id, user_id);
+        co_return;
+    }
+
+    auto current = crow::json::load(cached.body);
+    if (!current)
+    {
+        co_await deleteTaskFromCacheAsync(task_id, user_id);
+        co_return;
+    }
+
+    crow::json::wvalue patched(current);
+    for (const auto& key : fields.keys())
+        patched[key] = crow::json::wvalue(fields[key]);
+
+    std::string key = createCacheKey(task_id, user_id);
+    std::pmr::string value = cachedTaskValue(etag, patched.dump(), std::pmr::get_default_resource());
+    std::string ttl = std::to_string(TASK_CACHE_TTL + TASK_CACHE_STALE_TTL);
+    std::array<std::string_view, 7> args{ "EVAL", TASK_PATCH_SCRIPT, "1", key, cached.etag, value, ttl };
+    co_await redisCommandAsync(args);
+}
+
+asio::awaitable<void> saveMissingTaskInCacheAsync(int task_id, int user_id)
+{
+    std::string key = createCacheKey(task_id, user_id);
+    std::string ttl = std::to_string(TASK_NEGATIVE_CACHE_TTL);
+    std::array<std::string_view, 4> args{ "SETEX", key, ttl, "missing" };
+    co_await redisCommandAsync(args);
+}
+
+asio::awaitable<void> deleteTaskFromCacheAsync(int task_id, int user_id)
+{
+    std::string key = createCacheKey(task_id, user_id);
+    std::array<std::string_view, 2> args{ "DEL", key };
+    co_await redisCommandAsync(args);
+}
+
+namespace
+{
+    // Пользователи, для которых этот процесс не смог ни опубликовать новую версию списка, ни
+    // удалить старую. Пока ключ не удален, версии из Redis верить нельзя: она могла устареть
+    std::mutex unpublishedMutex;
+    std::unordered_set<int> unpublishedUsers;
+
+    bool isUnpublished(int user_id)
+    {
+        std::lock_guard<std::mutex> lock(unpublishedMutex);
+        return unpublishedUsers.contains(user_id);
+    }
+
+    void setUnpublished(int user_id, bool unpublished)
+    {
+        std::lock_guard<std::mutex> lock(unpublishedMutex);
+        if (unpublished)
+            unpublishedUsers.insert(user_id);
+        else
+            unpublishedUsers.erase(user_id);
+    }
+
+    asio::awaitable<bool> deleteTaskListVersionAsync(const std::string& key)
+    {
+        std::array<std::string_view, 2> args{ "DEL", key };
+        auto reply = co_await redisCommandAsync(args);
+        co_return reply && reply->type == REDIS_REPLY_INTEGER;
+    }
+}
+
+// Если прошлая запись версии не удалась, сначала повторяем удаление ключа, а до тех пор
+// версию считаем неизвестной, чтобы список перечитался из бд, а не ответил 304 по старой
+asio::awaitable<long long> getTaskListVersionFromCacheAsync(int user_id)
+{
+    long long version = -1;
+    std::string key = createTaskListVersionKey(user_id);
+    if (isUnpublished(user_id))
+    {
+        if (co_await deleteTaskListVersionAsync(key))
+            setUnpublished(user_id, false);
+        co_return version;
+    }
+
+    std::array<std::string_view, 2> args{ "GET", key };
+    auto reply = co_await redisCommandAsync(args);
+    if (reply && reply->type == REDIS_REPLY_STRING)
+        version = std::strtoll(reply->str, nullptr, 10);
+    co_return version;
+}
+
+// Версия, которую не удалось записать, не должна оставаться в Redis: старое значение дало бы
+// клиентам неверный 304. Если не удалось и удалить ключ, пользователь запоминается до успешного удаления
+asio::awaitable<void> saveTaskListVersionInCacheAsync(int user_id, long long version)
+{
+    std::string key = createTaskListVersionKey(user_id);
+    std::string value = std::to_string(version);
+    std::array<std::string_view, 5> args{ "EVAL", TASK_LIST_VERSION_SCRIPT, "1", key, value };
+    auto reply = co_await redisCommandAsync(args);
+    bool published = reply && reply->type != REDIS_REPLY_ERROR;
+    if (!published)
+        published = co_await deleteTaskListVersionAsync(key);
+    setUnpublished(user_id, !published);
+}
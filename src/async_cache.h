@@ -0,0 +1,59 @@
+﻿#ifndef ASYNC_CACHE_H
+#define ASYNC_CACHE_H
+
+#include <hiredis/hiredis.h>
+#include <sys/socket.h>
+#include <array>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include "async_pool.h"
+#include "cache.h"
+
+const int ASYNC_REDIS_POOL_SIZE = 4; // Неблокирующих соединений с Redis на каждый рабочий поток
+
+struct RedisReplyDeleter
+{
+    void operator()(redisReply* reply) const { freeReplyObject(reply); }
+};
+
+using RedisReplyPtr = std::unique_ptr<redisReply, RedisReplyDeleter>;
+
+// Соединение hiredis в неблокирующем режиме: команда записывается в буфер контекста, а чтение
+// и запись сокета выполняются, когда реактор asio сообщает о готовности
+class AsyncRedisConnection : public std::enable_shared_from_this<AsyncRedisConnection>
+{
+public:
+    AsyncRedisConnection(asio::any_io_executor executor);
+    ~AsyncRedisConnection();
+
+    asio::awaitable<void> connect(const std::string& host, int port);
+    asio::awaitable<RedisReplyPtr> command(std::span<const std::string_view> args);
+    bool isOpen() const;
+
+private:
+    redisContext* ctx;
+    asio::posix::stream_descriptor socket;
+    unsigned long long waits; // Номер текущего ожидания сокета, чтобы таймер не отменил следующее
+
+    asio::awaitable<void> wait(asio::posix::stream_descriptor::wait_type type, int timeoutMs);
+    void close(); // Сокетом владеет hiredis, поэтому asio его только освобождает
+};
+
+AsyncPool<AsyncRedisConnection>& asyncRedisPool();
+
+asio::awaitable<CachedTask> getTaskFromCacheAsync(int task_id, int user_id);
+asio::awaitable<void> saveTaskInCacheAsync(int task_id, int user_id, std::string_view body, std::string_view etag,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+asio::awaitable<void> patchTaskInCacheAsync(int task_id, int user_id, const std::string& previousEtag, const std::string& etag,
+    const crow::json::wvalue& fields);
+asio::awaitable<void> saveMissingTaskInCacheAsync(int task_id, int user_id);
+asio::awaitable<void> deleteTaskFromCacheAsync(int task_id, int user_id);
+asio::awaitable<long long> getTaskListVersionFromCacheAsync(int user_id);
+asio::awaitable<void> saveTaskListVersionInCacheAsync(int user_id, long long version);
+
+#endif
@@ -0,0 +1,493 @@
+﻿#include "async_database.h"
+
+PgResult& PgResult::operator=(PgResult&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (res)
+            PQclear(res);
+        res = other.res;
+        other.res = nullptr;
+    }
+    return *this;
+}
+
+PgResult::~PgResult()
+{
+    if (res)
+        PQclear(res);
+}
+
+int PgResult::size() const
+{
+    return res ? PQntuples(res) : 0;
+}
+
+// Количество строк, измененных INSERT/UPDATE/DELETE
+long long PgResult::affectedRows() const
+{
+    const char* rows = res ? PQcmdTuples(res) : "";
+    return *rows ? std::strtoll(rows, nullptr, 10) : 0;
+}
+
+int PgResult::columnIndex(const char* column) const
+{
+    int index = res ? PQfnumber(res, column) : -1;
+    if (index < 0)
+        throw std::out_of_range(std::string("Unknown column ") + column);
+    return index;
+}
+
+bool PgResult::isNull(int row, const char* column) const
+{
+    return PQgetisnull(res, row, columnIndex(column));
+}
+
+std::string PgResult::text(int row, const char* column) const
+{
+    int index = columnIndex(column);
+    return std::string(PQgetvalue(res, row, index), PQgetlength(res, row, index));
+}
+
+std::string_view PgResult::view(int row, const char* column) const
+{
+    int index = columnIndex(column);
+    return std::string_view(PQgetvalue(res, row, index), PQgetlength(res, row, index));
+}
+
+long long PgResult::integer(int row, const char* column) const
+{
+    return std::strtoll(PQgetvalue(res, row, columnIndex(column)), nullptr, 10);
+}
+
+bool PgResult::boolean(int row, const char* column) const
+{
+    return PQgetvalue(res, row, columnIndex(column))[0] == 't';
+}
+
+AsyncConnection::AsyncConnection(asio::any_io_executor executor) : conn(nullptr), socket(executor), waits(0), cancelling(false) {}
+
+AsyncConnection::~AsyncConnection()
+{
+    close();
+}
+
+// Регистрация сокета libpq в реакторе. При переподключении к другому адресу сокет меняется
+void AsyncConnection::assignSocket()
+{
+    int fd = PQsocket(conn);
+    if (socket.is_open() && socket.native_handle() == fd)
+        return;
+
+    if (socket.is_open())
+        socket.release();
+    if (fd >= 0)
+        socket.assign(fd);
+}
+
+// Установка соединения без блокировки потока
+asio::awaitable<void> AsyncConnection::connect(const std::string& connStr)
+{
+    conn = PQconnectStart(connStr.c_str());
+    if (!conn || PQstatus(conn) == CONNECTION_BAD)
+        throw std::runtime_error(conn ? PQerrorMessage(conn) : "Out of memory");
+
+    while (true)
+    {
+        PostgresPollingStatusType status = PQconnectPoll(conn);
+        assignSocket();
+
+        if (status == PGRES_POLLING_OK)
+            break;
+        if (status == PGRES_POLLING_FAILED)
+            throw std::runtime_error(PQerrorMessage(conn));
+
+        if (status == PGRES_POLLING_READING)
+            co_await socket.async_wait(asio::posix::stream_descriptor::wait_read, asio::use_awaitable);
+        else
+            co_await socket.async_wait(asio::posix::stream_descriptor::wait_write, asio::use_awaitable);
+    }
+
+    if (PQsetnonblocking(conn, 1) != 0)
+        throw std::runtime_error(PQerrorMessage(conn));
+}
+
+// Отправка буфера libpq: в неблокирующем режиме запрос может уйти в сокет не целиком
+asio::awaitable<void> AsyncConnection::flush()
+{
+    while (true)
+    {
+        int result = PQflush(conn);
+        if (result == 0)
+            co_return;
+        if (result < 0)
+            throw std::runtime_error(PQerrorMessage(conn));
+
+        co_await socket.async_wait(asio::posix::stream_descriptor::wait_write, asio::use_awaitable);
+    }
+}
+
+// Ожидание ответа бд. У запроса со сроком ожидание прерывается таймером, чтобы проверить срок: когда
+// он истек или клиент закрыл соединение, серверу отправляется отмена, а ответ (ошибка отмены)
+// дочитывается как обычно, чтобы соединение можно было вернуть в пул
+asio::awaitable<void> AsyncConnection::waitResult()
+{
+    while (true)
+    {
+        deadline::Deadline* requestDeadline = deadline::current;
+        if (!requestDeadline || cancelling)
+        {
+            co_await socket.async_wait(asio::posix::stream_descriptor::wait_read, asio::use_awaitable);
+            co_return;
+        }
+
+        // Таймер держит только слабую ссылку, соединение может быть удалено раньше, чем он сработает
+        unsigned long long id = ++waits;
+        asio::steady_timer timer(co_await asio::this_coro::executor, requestDeadline->nextCheck());
+        timer.async_wait([self = weak_from_this(), id](const crow::error_code& ec)
+            {
+                auto conn = self.lock();
+                if (!ec && conn && conn->waits == id && conn->socket.is_open())
+                    conn->socket.cancel();
+            });
+
+        crow::error_code ec;
+        co_await socket.async_wait(asio::posix::stream_descriptor::wait_read, asio::redirect_error(asio::use_awaitable, ec));
+        if (ec != asio::error::operation_aborted)
+        {
+            if (ec)
+                throw std::runtime_error(ec.message());
+            co_return;
+        }
+
+        if (requestDeadline->expired())
+        {
+            PGcancel* cancel = PQgetCancel(conn);
+            if (cancel)
+                QueryCanceller::getInstance().submit(cancel);
+            cancelling = true;
+        }
+    }
+}
+
+// Выполнение запроса с параметрами $1, $2, ... Возвращает результат последней команды запроса
+asio::awaitable<PgResult> AsyncConnection::query(const std::string& sql, const std::vector<std::optional<std::string>>& params)
+{
+    std::vector<const char*> values;
+    values.reserve(params.size());
+    for (const auto& param : params)
+        values.push_back(param ? param->c_str() : nullptr);
+
+    if (!PQsendQueryParams(conn, sql.c_str(), values.size(), nullptr, values.data(), nullptr, nullptr, 0))
+        throw std::runtime_error(PQerrorMessage(conn));
+    cancelling = false;
+
+    PgResult last;
+    std::string error;
+    try
+    {
+        co_await flush();
+
+        while (true)
+        {
+            while (PQisBusy(conn))
+            {
+                co_await waitResult();
+                if (!PQconsumeInput(conn))
+                    throw std::runtime_error(PQerrorMessage(conn));
+            }
+
+            PGresult* res = PQgetResult(conn);
+            if (!res)
+                break;
+
+            // Ошибку запоминаем, но результаты дочитываем до конца, чтобы соединение можно было вернуть в пул
+            PgResult current(res);
+            ExecStatusType status = PQresultStatus(res);
+            if (status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE)
+                error = PQresultErrorMessage(res);
+            last = std::move(current);
+        }
+    }
+    catch (...)
+    {
+        // Ответ на запрос не дочитан, такое соединение нельзя вернуть в пул
+        close();
+        throw;
+    }
+
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    co_return last;
+}
+
+// Выполнение запросов в режиме pipeline: запросы и Sync отправляются подряд, не дожидаясь ответов,
+// а результаты собираются в конце. Запросы до Sync сервер выполняет одной неявной транзакцией: после
+// ошибки остальные запросы не выполняются и транзакция откатывается. Возвращает результат каждого запроса
+asio::awaitable<std::vector<PgResult>> AsyncConnection::pipeline(const std::vector<Statement>& statements)
+{
+    // Отправленная команда: подготовка запроса или сам запрос. Каждая возвращает свою серию результатов
+    struct Command
+    {
+        size_t statement;
+        bool prepare;
+    };
+
+    std::vector<Command> commands;
+    std::unordered_set<std::string> preparing;
+    try
+    {
+        if (!PQenterPipelineMode(conn))
+            throw std::runtime_error(PQerrorMessage(conn));
+
+        std::vector<const char*> values;
+        for (size_t i = 0; i != statements.size(); ++i)
+        {
+            const auto& statement = statements[i];
+            values.clear();
+            for (const auto& param : statement.params)
+                values.push_back(param ? param->c_str() : nullptr);
+
+            int sent;
+            if (statement.name.empty())
+                sent = PQsendQueryParams(conn, statement.sql.c_str(), values.size(), nullptr, values.data(), nullptr, nullptr, 0);
+            else
+            {
+                // Подготовка уходит в том же pipeline перед первым выполнением
+                if (!prepared.count(statement.name) && preparing.insert(statement.name).second)
+                {
+                    if (!PQsendPrepare(conn, statement.name.c_str(), statement.sql.c_str(), values.size(), nullptr))
+                        throw std::runtime_error(PQerrorMessage(conn));
+                    commands.push_back({ i, true });
+                }
+                sent = PQsendQueryPrepared(conn, statement.name.c_str(), values.size(), values.data(), nullptr, nullptr, 0);
+            }
+
+            if (!sent)
+                throw std::runtime_error(PQerrorMessage(conn));
+            commands.push_back({ i, false });
+        }
+
+        if (!PQpipelineSync(conn))
+            throw std::runtime_error(PQerrorMessage(conn));
+    }
+    catch (...)
+    {
+        // Часть pipeline могла остаться в буфере libpq, такое соединение нельзя вернуть в пул
+        close();
+        throw;
+    }
+    cancelling = false;
+
+    std::vector<PgResult> results(statements.size());
+    std::string error;
+    try
+    {
+        co_await flush();
+
+        // Результаты команд идут по порядку, серия результатов каждой команды заканчивается nullptr,
+        // а весь pipeline - результатом PGRES_PIPELINE_SYNC
+        size_t command = 0;
+        while (true)
+        {
+            while (PQisBusy(conn))
+            {
+                co_await waitResult();
+                if (!PQconsumeInput(conn))
+                    throw std::runtime_error(PQerrorMessage(conn));
+            }
+
+            PGresult* res = PQgetResult(conn);
+            if (!res)
+            {
+                ++command;
+                continue;
+            }
+
+            PgResult current(res);
+            ExecStatusType status = PQresultStatus(res);
+            if (status == PGRES_PIPELINE_SYNC)
+                break;
+
+            // Ошибку запоминаем первую: результаты остальных команд - только отметки о пропуске
+            if ((status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE) && error.empty())
+                error = PQresultErrorMessage(res);
+
+            if (command >= commands.size())
+                continue;
+            if (!commands[command].prepare)
+                results[commands[command].statement] = std::move(current);
+            else if (status == PGRES_COMMAND_OK)
+                prepared.insert(statements[commands[command].statement].name); // Подготовленный запрос не откатывается вместе с транзакцией
+        }
+
+        if (!PQexitPipelineMode(conn))
+            throw std::runtime_error(PQerrorMessage(conn));
+    }
+    catch (...)
+    {
+        close();
+        throw;
+    }
+
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    co_return results;
+}
+
+void AsyncConnection::close()
+{
+    if (socket.is_open())
+        socket.release();
+    if (conn)
+        PQfinish(conn);
+    conn = nullptr;
+}
+
+bool AsyncConnection::isOpen() const
+{
+    return conn && PQstatus(conn) == CONNECTION_OK;
+}
+
+// Пул неблокирующих соединений текущего рабочего потока
+AsyncPool<AsyncConnection>& asyncConnectionPool()
+{
+    thread_local AsyncPool<AsyncConnection> pool(ASYNC_POOL_SIZE,
+        [](asio::any_io_executor executor) -> asio::awaitable<std::shared_ptr<AsyncConnection>>
+        {
+            auto conn = std::make_shared<AsyncConnection>(executor);
+            co_await conn->connect(CONNECTION_STRING);
+            co_return conn;
+        });
+    return pool;
+}
+
+QueryCanceller::QueryCanceller()
+{
+    std::thread([this] { run(); }).detach();
+}
+
+QueryCanceller& QueryCanceller::getInstance()
+{
+    static QueryCanceller canceller;
+    return canceller;
+}
+
+// При переполнении очереди отмена не отправляется: запрос остановит statement_timeout соединения
+void QueryCanceller::submit(PGcancel* cancel)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (queue.size() >= QUERY_CANCEL_QUEUE_LIMIT)
+    {
+        PQfreeCancel(cancel);
+        return;
+    }
+    queue.push_back(cancel);
+    ready.notify_one();
+}
+
+void QueryCanceller::run()
+{
+    while (true)
+    {
+        PGcancel* cancel;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            ready.wait(lock, [this] { return !queue.empty(); });
+            cancel = queue.front();
+            queue.pop_front();
+        }
+
+        char error[256];
+        if (!PQcancel(cancel, error, sizeof(error)))
+            CROW_LOG_WARNING << "Query cancel failed: " << error;
+        PQfreeCancel(cancel);
+    }
+}
+
+std::optional<std::string> toQueryParam(int value)
+{
+    return std::to_string(value);
+}
+
+std::optional<std::string> toQueryParam(long long value)
+{
+    return std::to_string(value);
+}
+
+std::optional<std::string> toQueryParam(const std::string& value)
+{
+    return value;
+}
+
+// Массив целых чисел в текстовом виде Postgres: {1,2,3}
+std::optional<std::string> toQueryParam(const std::vector<int>& values)
+{
+    std::string array = "{";
+    for (size_t i = 0; i != values.size(); ++i)
+    {
+        if (i != 0)
+            array += ',';
+        array += std::to_string(values[i]);
+    }
+    array += '}';
+    return array;
+}
+
+// Массив в текстовом виде Postgres: {"a","b"}, кавычки и обратная косая черта экранируются
+std::optional<std::string> toQueryParam(const std::vector<std::string>& values)
+{
+    std::string array = "{";
+    for (size_t i = 0; i != values.size(); ++i)
+    {
+        if (i != 0)
+            array += ',';
+        array += '"';
+        for (char c : values[i])
+        {
+            if (c == '"' || c == '\\')
+                array += '\\';
+            array += c;
+        }
+        array += '"';
+    }
+    array += '}';
+    return array;
+}
+
+asio::awaitable<std::vector<PgResult>> asyncPipeline(trace::Trace* requestTrace, const char* name, std::vector<Statement> statements)
+{
+    auto& pool = asyncConnectionPool();
+    trace::Span wait(requestTrace, "db.pool_wait");
+    AsyncPoolGuard<AsyncConnection> conn(pool, co_await pool.acquire());
+    wait.end();
+
+    // Запросы pipeline выполняются одновременно, поэтому время замеряется для всего pipeline
+    trace::Span query(requestTrace, "db.pipeline");
+    query.attribute("db.statement", name);
+    auto start = slowquery::Clock::now();
+    std::vector<PgResult> results = co_await conn->pipeline(statements);
+    auto elapsed = slowquery::Clock::now() - start;
+
+    if (slowquery::isSlow(elapsed))
+    {
+        long long rows = 0;
+        std::vector<std::string> sql;
+        std::vector<slowquery::Params> params;
+        for (size_t i = 0; i != statements.size(); ++i)
+        {
+            rows += results[i].affectedRows();
+            sql.push_back(std::move(statements[i].sql));
+            params.push_back(std::move(statements[i].params));
+        }
+        slowquery::report(name, std::move(sql), std::move(params), rows, elapsed);
+    }
+    co_return results;
+}
+
+asio::awaitable<std::vector<PgResult>> asyncPipeline(const char* name, std::vector<Statement> statements)
+{
+    return asyncPipeline(nullptr, name, std::move(statements));
+}
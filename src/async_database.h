@@ -0,0 +1,146 @@
+﻿#ifndef ASYNC_DATABASE_H
+#define ASYNC_DATABASE_H
+
+#include <libpq-fe.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "async_pool.h"
+#include "database.h"
+#include "trace.h"
+
+const int ASYNC_POOL_SIZE = 4; // Неблокирующих соединений с бд на каждый рабочий поток
+const size_t QUERY_CANCEL_QUEUE_LIMIT = 64; // Сколько отмен может ждать отправки, лишние отбрасываются
+
+// Результат запроса libpq, освобождается автоматически
+class PgResult
+{
+public:
+    PgResult() : res(nullptr) {}
+    explicit PgResult(PGresult* res) : res(res) {}
+    PgResult(PgResult&& other) noexcept : res(other.res) { other.res = nullptr; }
+    PgResult& operator=(PgResult&& other) noexcept;
+    ~PgResult();
+
+    int size() const;
+    bool empty() const { return size() == 0; }
+    long long affectedRows() const;
+    bool isNull(int row, const char* column) const;
+    std::string text(int row, const char* column) const;
+    std::string_view view(int row, const char* column) const; // Без копирования, пока жив результат
+    long long integer(int row, const char* column) const;
+    bool boolean(int row, const char* column) const;
+
+private:
+    PGresult* res;
+
+    int columnIndex(const char* column) const;
+};
+
+// Запрос pipeline с параметрами $1, $2, ... Запрос с именем выполняется как подготовленный:
+// на каждом соединении он готовится один раз, при первом выполнении
+struct Statement
+{
+    std::string sql;
+    std::vector<std::optional<std::string>> params;
+    std::string name;
+};
+
+// Соединение libpq в неблокирующем режиме, сокет которого зарегистрирован в реакторе asio:
+// пока запрос выполняется, корутина приостановлена, а поток обслуживает другие запросы
+class AsyncConnection : public std::enable_shared_from_this<AsyncConnection>
+{
+public:
+    AsyncConnection(asio::any_io_executor executor);
+    ~AsyncConnection();
+
+    asio::awaitable<void> connect(const std::string& connStr);
+    asio::awaitable<PgResult> query(const std::string& sql, const std::vector<std::optional<std::string>>& params);
+    asio::awaitable<std::vector<PgResult>> pipeline(const std::vector<Statement>& statements);
+    bool isOpen() const;
+
+private:
+    PGconn* conn;
+    asio::posix::stream_descriptor socket;
+    unsigned long long waits; // Номер текущего ожидания сокета, чтобы таймер не отменил следующее
+    bool cancelling; // Отмена текущего запроса уже отправлена
+    std::unordered_set<std::string> prepared; // Запросы, подготовленные на этом соединении
+
+    asio::awaitable<void> flush();
+    asio::awaitable<void> waitResult();
+    void assignSocket();
+    void close(); // Сокетом владеет libpq, поэтому asio его только освобождает
+};
+
+AsyncPool<AsyncConnection>& asyncConnectionPool();
+
+// Отправка отмены запросов, которые больше никому не нужны. PQcancel открывает новое соединение с
+// сервером и ждет ответа, поэтому выполняется в своем потоке, а не в рабочем потоке Crow
+class QueryCanceller
+{
+public:
+    static QueryCanceller& getInstance();
+    void submit(PGcancel* cancel);
+
+private:
+    QueryCanceller();
+
+    std::mutex mtx;
+    std::condition_variable ready;
+    std::deque<PGcancel*> queue;
+
+    void run();
+};
+
+std::optional<std::string> toQueryParam(int value);
+std::optional<std::string> toQueryParam(long long value);
+std::optional<std::string> toQueryParam(const std::string& value);
+std::optional<std::string> toQueryParam(const std::vector<int>& values);
+std::optional<std::string> toQueryParam(const std::vector<std::string>& values);
+
+template <typename... Args>
+Statement statement(std::string sql, const Args&... args)
+{
+    return { std::move(sql), { toQueryParam(args)... }, std::string() };
+}
+
+// Выполнение запроса на соединении из пула текущего потока. Ожидание соединения и сам запрос
+// записываются в трассу отдельными участками, медленное выполнение - в журнал под именем name
+template <typename... Args>
+asio::awaitable<PgResult> asyncQuery(trace::Trace* requestTrace, const char* name, const std::string& sql, const Args&... args)
+{
+    std::vector<std::optional<std::string>> params{ toQueryParam(args)... };
+
+    auto& pool = asyncConnectionPool();
+    trace::Span wait(requestTrace, "db.pool_wait");
+    AsyncPoolGuard<AsyncConnection> conn(pool, co_await pool.acquire());
+    wait.end();
+
+    trace::Span query(requestTrace, "db.query");
+    query.attribute("db.statement", name);
+    auto start = slowquery::Clock::now();
+    PgResult result = co_await conn->query(sql, params);
+    auto elapsed = slowquery::Clock::now() - start;
+
+    if (slowquery::isSlow(elapsed))
+        slowquery::report(name, { sql }, { std::move(params) }, result.affectedRows(), elapsed);
+    co_return result;
+}
+
+template <typename... Args>
+asio::awaitable<PgResult> asyncQuery(const char* name, const std::string& sql, const Args&... args)
+{
+    return asyncQuery(static_cast<trace::Trace*>(nullptr), name, sql, args...);
+}
+
+// Выполнение запросов одним pipeline на соединении из пула текущего потока: одна неявная транзакция
+// и один проход по сети. Медленное выполнение записывается в журнал под именем name
+asio::awaitable<std::vector<PgResult>> asyncPipeline(trace::Trace* requestTrace, const char* name, std::vector<Statement> statements);
+asio::awaitable<std::vector<PgResult>> asyncPipeline(const char* name, std::vector<Statement> statements);
+
+#endif
@@ -0,0 +1,131 @@
+﻿#ifndef ASYNC_POOL_H
+#define ASYNC_POOL_H
+
+#include "crow_all.h"
+#include "deadline.h"
+#include "fairness.h"
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifdef CROW_USE_BOOST
+namespace asio = boost::asio;
+#endif
+
+// Пул неблокирующих соединений одного рабочего потока. Каждый io_context Crow обслуживается одним
+// потоком, а сокеты соединений зарегистрированы в его реакторе, поэтому соединения не переходят
+// между потоками и пулу не нужны блокировки. Пока свободных соединений нет, корутина ждет на таймере
+// в честной очереди пользователей. Ожидание прекращается исключением deadline::Expired, когда истекает
+// срок запроса
+template <typename Connection>
+class AsyncPool
+{
+public:
+    using Factory = std::function<asio::awaitable<std::shared_ptr<Connection>>(asio::any_io_executor)>;
+
+    AsyncPool(unsigned int maxSize, Factory create) : maxSize(maxSize), curSize(0), create(std::move(create)) {}
+
+    asio::awaitable<std::shared_ptr<Connection>> acquire()
+    {
+        auto executor = co_await asio::this_coro::executor;
+
+        while (true)
+        {
+            deadline::check();
+
+            while (!idle.empty())
+            {
+                auto conn = idle.back();
+                idle.pop_back();
+                if (conn->isOpen())
+                    co_return conn;
+                --curSize; // Разорванное соединение выбрасываем
+            }
+
+            if (curSize < maxSize)
+            {
+                ++curSize;
+                try
+                {
+                    co_return co_await create(executor);
+                }
+                catch (...)
+                {
+                    --curSize;
+                    throw;
+                }
+            }
+
+            // Ждем, пока release передаст соединение и разбудит нас отменой таймера. Если у запроса
+            // есть срок, таймер срабатывает сам, чтобы проверить срок, и тогда ожидающий убирает себя
+            // из очереди. Соединение передается ожидающему напрямую, иначе его мог бы перехватить
+            // запрос, который пришел позже и в очереди не стоял
+            auto wakeAt = deadline::current ? deadline::current->nextCheck() : asio::steady_timer::time_point::max();
+            auto waiter = std::make_shared<Waiter>(executor, wakeAt);
+            waiters.push(fairness::currentUser, waiter);
+            crow::error_code ec;
+            co_await waiter->timer.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+            waiters.erase(waiter);
+            if (waiter->conn)
+                co_return std::move(waiter->conn);
+        }
+    }
+
+    void release(std::shared_ptr<Connection> conn)
+    {
+        if (!conn->isOpen())
+        {
+            // Место освободилось, следующий ожидающий создаст новое соединение
+            --curSize;
+            if (!waiters.empty())
+                waiters.pop()->timer.cancel();
+            return;
+        }
+
+        if (waiters.empty())
+        {
+            idle.push_back(std::move(conn));
+            return;
+        }
+
+        auto waiter = waiters.pop();
+        waiter->conn = std::move(conn);
+        waiter->timer.cancel();
+    }
+
+private:
+    struct Waiter
+    {
+        Waiter(asio::any_io_executor executor, asio::steady_timer::time_point wakeAt) : timer(executor, wakeAt) {}
+
+        asio::steady_timer timer;
+        std::shared_ptr<Connection> conn; // Соединение, переданное ожидающему
+    };
+
+    unsigned int maxSize;
+    unsigned int curSize;
+    Factory create;
+    std::vector<std::shared_ptr<Connection>> idle;
+    fairness::FairQueue<std::shared_ptr<Waiter>> waiters; // Пользователи обслуживаются по очереди
+};
+
+// Возврат соединения в пул после выхода из зоны видимости
+template <typename Connection>
+class AsyncPoolGuard
+{
+public:
+    AsyncPoolGuard(AsyncPool<Connection>& pool, std::shared_ptr<Connection> conn) : pool(pool), conn(std::move(conn)) {}
+    ~AsyncPoolGuard() { pool.release(std::move(conn)); }
+    AsyncPoolGuard(const AsyncPoolGuard&) = delete;
+    AsyncPoolGuard& operator=(const AsyncPoolGuard&) = delete;
+
+    Connection* operator->() { return conn.get(); }
+
+private:
+    AsyncPool<Connection>& pool;
+    std::shared_ptr<Connection> conn;
+};
+
+#endif
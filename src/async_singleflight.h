@@ -0,0 +1,127 @@
+﻿#ifndef ASYNC_SINGLEFLIGHT_H
+#define ASYNC_SINGLEFLIGHT_H
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "async_pool.h"
+#include "deadline.h"
+
+// Объединение одновременных загрузок по одному ключу для корутин: первая корутина выполняет загрузку,
+// остальные приостанавливаются на таймере и не занимают поток. Корутины могут выполняться в разных
+// рабочих потоках, поэтому по окончании загрузки отмена таймера отправляется в поток каждой ожидающей.
+// Загрузка идет со сроком первой корутины: если он истек, ожидающие не получают чужую ошибку срока,
+// а повторяют загрузку (одна из них становится новой первой)
+template <typename T>
+class AsyncSingleFlight
+{
+public:
+    asio::awaitable<T> run(const std::string& key, std::function<asio::awaitable<T>()> load)
+    {
+        auto executor = co_await asio::this_coro::executor;
+
+        std::unique_lock<std::mutex> lock(mtx);
+        auto it = inFlight.find(key);
+        while (it != inFlight.end())
+        {
+            auto flight = it->second;
+            auto timer = std::make_shared<asio::steady_timer>(executor);
+            flight->waiters.push_back(timer);
+            lock.unlock();
+
+            // Таймер срабатывает к следующей проверке срока ожидающей корутины, а отменяется по окончании
+            // загрузки. Отмена выполняется в этом же потоке, поэтому не может случиться раньше ожидания,
+            // а отмену, пришедшую вместе со срабатыванием, видно по флагу done
+            while (!isDone(*flight))
+            {
+                timer->expires_at(deadline::current ? deadline::current->nextCheck() : asio::steady_timer::time_point::max());
+                crow::error_code ec;
+                co_await timer->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+                if (!isDone(*flight))
+                    deadline::check();
+            }
+
+            if (!flight->expired)
+            {
+                if (flight->error)
+                    std::rethrow_exception(flight->error);
+                co_return *flight->value;
+            }
+
+            deadline::check();
+            lock.lock();
+            it = inFlight.find(key);
+        }
+
+        auto flight = std::make_shared<Flight>();
+        inFlight.emplace(key, flight);
+        lock.unlock();
+
+        try
+        {
+            flight->value = co_await load();
+        }
+        catch (const deadline::Expired&)
+        {
+            flight->error = std::current_exception();
+            flight->expired = true;
+        }
+        catch (...)
+        {
+            flight->error = std::current_exception();
+        }
+
+        finish(key, flight);
+
+        if (flight->error)
+            std::rethrow_exception(flight->error);
+        co_return *flight->value;
+    }
+
+    // Идет ли сейчас загрузка по ключу
+    bool inProgress(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return inFlight.count(key) != 0;
+    }
+
+private:
+    struct Flight
+    {
+        std::optional<T> value;
+        std::exception_ptr error;
+        bool expired = false; // Загрузка прервана по сроку первой корутины
+        bool done = false;
+        std::vector<std::shared_ptr<asio::steady_timer>> waiters;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> inFlight;
+
+    bool isDone(const Flight& flight)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return flight.done;
+    }
+
+    void finish(const std::string& key, const std::shared_ptr<Flight>& flight)
+    {
+        std::vector<std::shared_ptr<asio::steady_timer>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            inFlight.erase(key);
+            flight->done = true;
+            waiters.swap(flight->waiters);
+        }
+
+        for (auto& timer : waiters)
+            asio::post(timer->get_executor(), [timer] { timer->cancel(); });
+    }
+};
+
+#endif
@@ -5,6 +5,14 @@ namespace auth
     // Проверка токена и помещение id пользователя в переменную user_id
     bool checkToken(const crow::request& req, int& user_id)
     {
+        // Токен уже проверен промежуточным слоем для этого запроса
+        int verified = accesslog::user(req);
+        if (verified > 0)
+        {
+            user_id = verified;
+            return true;
+        }
+
         try
         {
             std::string token = req.get_header_value("Authorization");
@@ -33,6 +41,7 @@ namespace auth
                 return false;
             }
 
+            accesslog::setUser(req, user_id);
             return true;
         }
         catch (const std::exception& e) 
@@ -95,7 +104,7 @@ namespace auth
     {
         auto db = connectDB();
         pqxx::nontransaction txn(db);
-        pqxx::result result = txn.exec_params(
+        pqxx::result result = execTimed(txn, "check_user",
             "SELECT user_id, password, salt FROM users WHERE username = $1", username);
 
         if (result.empty())
@@ -140,6 +149,7 @@ namespace auth
             {
                 return crow::response(401, "Invalid username or password");
             }
+            accesslog::setUser(req, user_id);
 
             auto token = generateToken(user_id);
 
@@ -172,9 +182,9 @@ namespace auth
 
             pqxx::work txn(db);
 
-            pqxx::result result = txn.exec_params(
+            pqxx::result result = execTimed(txn, "find_user_by_name",
                 "SELECT user_id FROM users WHERE username = $1", username);
-            pqxx::result resultEmail = txn.exec_params(
+            pqxx::result resultEmail = execTimed(txn, "find_user_by_email",
                 "SELECT user_id FROM users WHERE email = $1", email);
 
             if (!result.empty())
@@ -189,7 +199,7 @@ namespace auth
             std::string salt;
             std::string hashedPassword = hashPassword(password, salt);
 
-            txn.exec_params(
+            execTimed(txn, "insert_user",
                 "INSERT INTO users (username, password, email, salt) VALUES ($1, $2, $3, $4)",
                 username, hashedPassword, email, salt);
             txn.commit();
@@ -6,6 +6,7 @@
 #include <jwt-cpp/jwt.h>
 #include "argon2.h"
 #include "database.h"
+#include "access_log.h"
 
 namespace auth 
 {
@@ -0,0 +1,185 @@
+﻿#include "bloom.h"
+#include <thread>
+
+TaskIdFilter::TaskIdFilter() : watermark(0), currentGeneration(0), rebuilding(false)
+{
+    rebuild();
+
+    // Фоновая перестройка убирает удаленные другими экземплярами задачи и сдвигает границу
+    std::thread([this]
+    {
+        while (true)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(TASK_FILTER_REBUILD_INTERVAL));
+            try
+            {
+                rebuild();
+            }
+            catch (const std::exception&)
+            {
+                // Оставляем старый фильтр до следующей попытки
+            }
+        }
+    }).detach();
+}
+
+// Получение единственного экземпляра фильтра, при первом вызове загружает все task_id из бд
+TaskIdFilter& TaskIdFilter::getInstance()
+{
+    static TaskIdFilter filter;
+    return filter;
+}
+
+// Позиции счетчиков для task_id (двойное хеширование)
+void TaskIdFilter::positions(int task_id, size_t size, size_t* result) const
+{
+    uint64_t x = static_cast<uint64_t>(static_cast<uint32_t>(task_id)) + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    uint64_t h1 = x & 0xffffffff;
+    uint64_t h2 = (x >> 32) | 1;
+
+    for (int i = 0; i != TASK_FILTER_HASHES; ++i)
+        result[i] = (h1 + i * h2) % size;
+}
+
+// Может ли задача существовать. false означает, что задачи точно нет и в бд можно не ходить
+bool TaskIdFilter::mayExist(int task_id)
+{
+    std::shared_lock<std::shared_mutex> lock(mtx);
+
+    if (task_id <= 0)
+        return false;
+    if (task_id > watermark || counters.empty())
+        return true;
+
+    size_t pos[TASK_FILTER_HASHES];
+    positions(task_id, counters.size(), pos);
+
+    for (size_t p : pos)
+    {
+        if (counters[p] == 0)
+            return false;
+    }
+    return true;
+}
+
+// Добавление созданной задачи
+void TaskIdFilter::add(int task_id)
+{
+    std::unique_lock<std::shared_mutex> lock(mtx);
+
+    if (rebuilding)
+        addedDuringRebuild.push_back(task_id);
+    if (counters.empty())
+        return;
+
+    size_t pos[TASK_FILTER_HASHES];
+    positions(task_id, counters.size(), pos);
+
+    for (size_t p : pos)
+    {
+        if (counters[p] != UINT8_MAX)
+            ++counters[p];
+    }
+}
+
+// Поколение счетчиков. Берется до удаления задачи из бд и передается в remove
+unsigned long long TaskIdFilter::generation()
+{
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return currentGeneration;
+}
+
+// Удаление задачи, удаленной из бд после вызова generation. Уменьшаем счетчики только для id, которые
+// точно были добавлены при перестройке, иначе можно обнулить чужие счетчики и получить ложное "задачи нет".
+// Если с тех пор фильтр перестроен, выборка для него могла быть сделана уже после удаления, и id в нее
+// не попал: такой id остается в фильтре до следующей перестройки, что дает лишь лишний запрос в бд
+void TaskIdFilter::remove(int task_id, unsigned long long startedGeneration)
+{
+    std::unique_lock<std::shared_mutex> lock(mtx);
+
+    if (counters.empty() || task_id > watermark || startedGeneration != currentGeneration)
+        return;
+
+    size_t pos[TASK_FILTER_HASHES];
+    positions(task_id, counters.size(), pos);
+
+    for (size_t p : pos)
+    {
+        // Насыщенный счетчик больше не уменьшаем, так как не знаем его настоящее значение
+        if (counters[p] != 0 && counters[p] != UINT8_MAX)
+            --counters[p];
+    }
+}
+
+// Полная перестройка фильтра по таблице tasks. created_at - время начала транзакции вставки, поэтому
+// задача, которая к моменту выборки еще не зафиксирована, получила id позже любой задачи, созданной
+// раньше окна отставания (пока транзакция вставки короче половины окна), и граница ее не накрывает
+void TaskIdFilter::rebuild()
+{
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        rebuilding = true;
+        addedDuringRebuild.clear();
+    }
+
+    std::vector<int> ids;
+    int newWatermark = 0;
+    try
+    {
+        auto db = connectDB();
+        pqxx::nontransaction txn(db);
+        pqxx::result result = execTimed(txn, "load_task_ids",
+            "SELECT task_id, created_at < LOCALTIMESTAMP - make_interval(secs => $1) AS settled FROM tasks",
+            TASK_FILTER_WATERMARK_LAG);
+
+        ids.reserve(result.size());
+        for (const auto& row : result)
+        {
+            int id = row[0].as<int>();
+            ids.push_back(id);
+            if (!row[1].is_null() && row[1].as<bool>())
+                newWatermark = std::max(newWatermark, id);
+        }
+    }
+    catch (...)
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        rebuilding = false;
+        addedDuringRebuild.clear();
+        throw;
+    }
+
+    size_t size = std::max<size_t>(1024, ids.size() * TASK_FILTER_BITS_PER_TASK);
+    std::vector<uint8_t> newCounters(size, 0);
+
+    size_t pos[TASK_FILTER_HASHES];
+    auto insert = [&](int id)
+    {
+        positions(id, size, pos);
+        for (size_t p : pos)
+        {
+            if (newCounters[p] != UINT8_MAX)
+                ++newCounters[p];
+        }
+    };
+    for (int id : ids)
+        insert(id);
+
+    // Новое поколение начинается после выборки: удаление, начатое позже, выполняется в бд уже после нее,
+    // поэтому удаляемая задача в выборке есть и ее счетчики можно уменьшать. Задачи, добавленные
+    // во время выборки, могли в нее не попасть, поэтому добавляем их еще раз: лишний счетчик дает
+    // только лишний запрос в бд, а пропущенный - ложный 404
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    for (int id : addedDuringRebuild)
+        insert(id);
+    addedDuringRebuild.clear();
+    rebuilding = false;
+
+    counters.swap(newCounters);
+    watermark = newWatermark;
+    ++currentGeneration;
+}
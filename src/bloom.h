@@ -0,0 +1,43 @@
+﻿#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+#include <chrono>
+#include "database.h"
+
+const int TASK_FILTER_HASHES = 7; // Количество хеш-функций
+const int TASK_FILTER_BITS_PER_TASK = 10; // Около 1% ложноположительных срабатываний
+const int TASK_FILTER_REBUILD_INTERVAL = 600; // Период полной перестройки фильтра (сек)
+const int TASK_FILTER_WATERMARK_LAG = 60; // Задачи моложе этого (сек) не сдвигают границу фильтра
+
+// Счетный фильтр Блума существующих task_id. Отвечает "точно нет" только для id не больше границы:
+// максимального id среди задач, созданных раньше TASK_FILTER_WATERMARK_LAG до последней перестройки.
+// id выдаются до фиксации вставки, поэтому задача с меньшим id может стать видна уже после выборки,
+// отставание границы оставляет такие id за ней. Для более новых id всегда нужен запрос в бд.
+// Каждая перестройка начинает новое поколение счетчиков: удаление, начатое в прошлом поколении,
+// к новым счетчикам не применяется, так как неизвестно, попала ли удаляемая задача в их выборку
+class TaskIdFilter
+{
+public:
+    static TaskIdFilter& getInstance();
+    bool mayExist(int task_id);
+    void add(int task_id);
+    unsigned long long generation();
+    void remove(int task_id, unsigned long long startedGeneration);
+    void rebuild();
+
+private:
+    TaskIdFilter();
+    std::shared_mutex mtx;
+    std::vector<uint8_t> counters;
+    int watermark;
+    unsigned long long currentGeneration; // Номер перестройки, по которой построены счетчики
+    bool rebuilding;
+    std::vector<int> addedDuringRebuild; // Задачи, созданные после начала выборки, переносятся в новые счетчики
+
+    void positions(int task_id, size_t size, size_t* result) const;
+};
+
+#endif
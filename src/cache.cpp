@@ -3,59 +3,95 @@
 RedisConnectionPool::RedisConnectionPool(const std::string& host, int port, unsigned int minSize, unsigned int maxSize)
     : host(host), port(port), minSize(minSize), maxSize(maxSize), curSize(0)
 {
+    // Если Redis недоступен при запуске, пул начинает пустым и создает соединения по мере надобности
     for (unsigned int i = 0; i != minSize; ++i)
     {
-        connections.push_back(createConnection());
+        redisContext* conn = createConnection();
+        if (!conn)
+            break;
+        connections.push_back(conn);
         ++curSize;
     }
 }
 
+static unsigned int redisPoolMinSize = MIN_SIZE_R;
+static unsigned int redisPoolMaxSize = MAX_SIZE_R;
+
 // Получение единственного экземпляра пула соединений
 RedisConnectionPool& RedisConnectionPool::getInstance()
 {
-    static RedisConnectionPool pool(HOST, PORT, MIN_SIZE_R, MAX_SIZE_R);
+    static RedisConnectionPool pool(HOST, PORT, redisPoolMinSize, redisPoolMaxSize);
     return pool;
 }
 
-// Взять соединение из пула
+// Размер пула, действует только до первого вызова getInstance
+void RedisConnectionPool::setSize(unsigned int minSize, unsigned int maxSize)
+{
+    redisPoolMinSize = minSize;
+    redisPoolMaxSize = maxSize;
+}
+
+// Взять соединение из пула, nullptr если подключиться не удалось. Новое соединение создается
+// без блокировки пула, чтобы остальные потоки не ждали таймаута подключения
 redisContext* RedisConnectionPool::getConnection()
 {
     std::unique_lock<std::mutex> lock(mtx);
 
-    if (connections.empty() && curSize < maxSize)
+    poolWaiting.wait(lock, [this] { return !connections.empty() || curSize < maxSize; });
+
+    if (!connections.empty())
     {
-        connections.push_back(createConnection());
-        ++curSize;
+        auto conn = connections.back();
+        connections.pop_back();
+        return conn;
     }
 
-    poolWaiting.wait(lock, [this] { return !connections.empty(); });
+    ++curSize;
+    lock.unlock();
 
-    auto conn = connections.back();
-    connections.pop_back();
-
-    if (!conn || conn->err)
+    redisContext* conn = createConnection();
+    if (!conn)
     {
-        conn = createConnection();
+        lock.lock();
+        --curSize;
+        poolWaiting.notify_one();
     }
-
     return conn;
 }
 
-// Вернуть соединение в пул 
+// Вернуть соединение в пул. Соединение с ошибкой (разрыв, таймаут) больше не используется:
+// оно закрывается, а место в пуле освобождается для нового
 void RedisConnectionPool::returnConnection(redisContext* conn)
 {
+    if (!conn)
+        return;
+
     std::unique_lock<std::mutex> lock(mtx);
 
-    connections.push_back(conn);
+    if (conn->err)
+    {
+        redisFree(conn);
+        --curSize;
+    }
+    else
+        connections.push_back(conn);
 
     poolWaiting.notify_one();
 }
 
-// Создание нового соединения
+// Создание нового соединения с таймаутами на подключение и на команды, nullptr при ошибке
 redisContext* RedisConnectionPool::createConnection()
 {
-    timeval timeout = { 0, 0 }; // Если соединение не устанавливается, то не ждем 
-    return redisConnectWithTimeout(host.c_str(), port, timeout);
+    timeval connectTimeout = { 0, REDIS_CONNECT_TIMEOUT_MS * 1000 };
+    timeval commandTimeout = { 0, REDIS_COMMAND_TIMEOUT_MS * 1000 };
+
+    redisContext* conn = redisConnectWithTimeout(host.c_str(), port, connectTimeout);
+    if (conn && !conn->err && redisSetTimeout(conn, commandTimeout) == REDIS_OK)
+        return conn;
+
+    if (conn)
+        redisFree(conn);
+    return nullptr;
 }
 
 // Количество доступных соединений
@@ -70,11 +106,30 @@ unsigned int RedisConnectionPool::activeConnections() const
     return curSize - connections.size();
 }
 
+CircuitBreaker& redisCircuitBreaker()
+{
+    static CircuitBreaker breaker("Redis", REDIS_BREAKER_FAILURES, std::chrono::milliseconds(REDIS_BREAKER_OPEN_MS),
+        std::chrono::milliseconds(REDIS_BREAKER_MAX_OPEN_MS));
+    return breaker;
+}
+
+// Кэш не нужен запросу, срок которого истек: такой запрос не берет соединение вовсе
 RedisConnectionGuard::RedisConnectionGuard()
-    : conn(RedisConnectionPool::getInstance().getConnection()) {}
+    : conn(nullptr), attempted(!deadline::expired() && redisCircuitBreaker().allow())
+{
+    if (attempted)
+        conn = RedisConnectionPool::getInstance().getConnection();
+}
 
 RedisConnectionGuard::~RedisConnectionGuard()
 {
+    if (!attempted)
+        return;
+
+    if (conn && !conn->err)
+        redisCircuitBreaker().success();
+    else
+        redisCircuitBreaker().failure();
     RedisConnectionPool::getInstance().returnConnection(conn);
 }
 
@@ -85,75 +140,52 @@ RedisConnectionGuard connectRedis()
 }
 
 // Формирование ключа
-inline std::string createCacheKey(int task_id, int user_id) {
+std::string createCacheKey(int task_id, int user_id) {
     return "task:" + std::to_string(task_id) + ":user:" + std::to_string(user_id);
 }
 
-// Получение задачи из кэша
-crow::json::wvalue getTaskFromCache(int task_id, int user_id)
+// Ключ версии списка задач пользователя
+std::string createTaskListVersionKey(int user_id)
 {
-    crow::json::wvalue response;
-    auto redis = connectRedis();
-    if (redis)
-    {
-        std::string cacheKey = createCacheKey(task_id, user_id);
-        redisReply* reply = (redisReply*)redisCommand(redis, "GET %s", cacheKey.c_str());
-        if (reply && reply->type == REDIS_REPLY_STRING)
-        {
-            response = crow::json::load(reply->str);
-            redisCommand(redis, "EXPIRE %s 300", cacheKey.c_str()); // Продлеваем время жизни ключа до 5 минут
-            freeReplyObject(reply);
-        }
-        else
-        {
-            response["null"] = "null"; // Специальная метка, обозначающая, что ответ в кэше не найден
-        }
-    }
-    return response;
+    return "tasks:user:" + std::to_string(user_id) + ":version";
 }
 
-// Сохранение задачи в кэше
-void saveTaskInCache(int task_id, int user_id, const crow::json::wvalue& response)
+// Разбор записи задачи в кэше. В кэше хранится строка "<срок свежести>\n<etag>\n<json>", поэтому ETag
+// можно сравнить с If-None-Match без разбора JSON
+CachedTask parseCachedTask(std::string_view value)
 {
-    auto redis = connectRedis();
-    if (redis)
+    CachedTask cached;
+    cached.missing = value == "missing";
+    size_t first = value.find('\n');
+    size_t second = first == std::string_view::npos ? first : value.find('\n', first + 1);
+    if (second != std::string_view::npos)
     {
-        std::string cacheKey = createCacheKey(task_id, user_id);
-        std::string jsonData = response.dump();
-        redisCommand(redis, "SETEX %s 300 %s", cacheKey.c_str(), jsonData.c_str()); // Устанавливаем время жизни ключа 5 минут
+        long long freshUntil = std::strtoll(std::string(value.substr(0, first)).c_str(), nullptr, 10);
+        long long now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        cached.stale = now >= freshUntil;
+        cached.etag = value.substr(first + 1, second - first - 1);
+        cached.body = value.substr(second + 1);
     }
+    return cached;
 }
 
-void saveTaskInCache(int task_id, int user_id, std::string task_name, std::string description
-    , std::string status_name, int priority, std::string due_date, std::vector<std::string> tags)
+// Момент, до которого сохраняемая сейчас задача считается свежей
+static long long cacheFreshUntil()
 {
-    crow::json::wvalue jsonForCache;
-    jsonForCache["task_id"] = task_id;
-    jsonForCache["task_name"] = task_name;
-    jsonForCache["description"] = description;
-    jsonForCache["status_name"] = status_name;
-    jsonForCache["priority"] = priority;
-    jsonForCache["due_date"] = due_date;
-
-    if (tags.size() != 0)
-    {
-        for (int i = 0; i != tags.size(); ++i)
-        {
-            jsonForCache["tags"][i] = tags[i];
-        }
-    }
-    else
-        jsonForCache["tags"][0];
-
-    saveTaskInCache(task_id, user_id, jsonForCache);
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() + TASK_CACHE_TTL;
 }
 
-void deleteTaskFromCache(int task_id, int user_id)
+// Запись задачи для кэша со сроком свежести TASK_CACHE_TTL, собранная на арене запроса одним выделением памяти
+std::pmr::string cachedTaskValue(std::string_view etag, std::string_view body, std::pmr::memory_resource* resource)
 {
-    auto redis = connectRedis();
-    if (redis)
-    {
-        std::string cacheKey = createCacheKey(task_id, user_id);
-        redisCommand(redis, "DEL %s", cacheKey.c_str());
-    }
-}
+    char freshUntil[24];
+    auto end = std::to_chars(freshUntil, freshUntil + sizeof(freshUntil), cacheFreshUntil()).ptr;
+
+    std::pmr::string value(resource);
+    value.reserve((end - freshUntil) + etag.size() + body.size() + 2);
+    value.append(freshUntil, end).append(1, '\n').append(etag).append(1, '\n').append(body);
+    return value;
+}
\ No newline at end of file
@@ -3,20 +3,51 @@
 
 #include <hiredis/hiredis.h>
 #include "crow_all.h"
+#include <charconv>
+#include <memory_resource>
 #include <mutex>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <chrono>
 #include <condition_variable>
+#include "circuit_breaker.h"
+#include "deadline.h"
 
 const std::string HOST = "redis";
 const int PORT = 6379;
 const int MIN_SIZE_R = 3;
 const int MAX_SIZE_R = 10;
+const int MIN_SIZE_R_PER_CORE = 1; // В режиме по ядру пул у каждого процесса свой, поэтому меньше
+const int MAX_SIZE_R_PER_CORE = 3;
+const int REDIS_CONNECT_TIMEOUT_MS = 50; // Сколько ждать подключения к Redis
+const int REDIS_COMMAND_TIMEOUT_MS = 50; // Сколько ждать ответа на команду, после этого соединение закрывается
+const int REDIS_BREAKER_FAILURES = 5; // Ошибок подряд, после которых Redis считается недоступным
+const int REDIS_BREAKER_OPEN_MS = 500; // Время до первой попытки обратиться к недоступному Redis
+const int REDIS_BREAKER_MAX_OPEN_MS = 30000; // Больше этого время между попытками не растет
+const int TASK_CACHE_TTL = 300; // Время, в течение которого задача в кэше считается свежей (сек)
+const int TASK_CACHE_STALE_TTL = 60; // Сколько еще можно отдавать устаревшую задачу, пока она обновляется (сек)
+const int TASK_NEGATIVE_CACHE_TTL = 30; // Время жизни отметки о том, что задачи нет или она чужая (сек)
+
+// Версия списка задач только растет: скрипт не перезапишет более новое значение,
+// даже если запись и чтение из бд завершились в другом порядке
+const std::string TASK_LIST_VERSION_SCRIPT =
+    "local cur = tonumber(redis.call('GET', KEYS[1])) "
+    "if not cur or cur < tonumber(ARGV[1]) then redis.call('SET', KEYS[1], ARGV[1], 'EX', 300) end "
+    "return 0";
+
+// Запись задачи заменяется, только если за время изменения ее ETag не поменялся, иначе удаляется
+const std::string TASK_PATCH_SCRIPT =
+    "local v = redis.call('GET', KEYS[1]) "
+    "if v and string.match(v, '^[^\\n]*\\n([^\\n]*)\\n') == ARGV[1] then "
+    "redis.call('SET', KEYS[1], ARGV[2], 'EX', ARGV[3]) return 1 end "
+    "redis.call('DEL', KEYS[1]) return 0";
 
 class RedisConnectionPool
 {
 public:
     static RedisConnectionPool& getInstance();
+    static void setSize(unsigned int minSize, unsigned int maxSize);
     redisContext* getConnection();
     void returnConnection(redisContext* conn);
     unsigned int availableConnections() const;
@@ -31,30 +62,45 @@ private:
     unsigned int curSize;
     std::mutex mtx;
     std::condition_variable poolWaiting;
-    std::vector<redisContext*> connections;
+    std::vector<redisContext*> connections; // Только исправные соединения
 
     redisContext* createConnection();
 };
 
-// Класс для автоматического возврата соединения в пул после выхода из зоны видимости
+// Автомат защиты Redis, общий для синхронного и неблокирующих пулов процесса
+CircuitBreaker& redisCircuitBreaker();
+
+// Класс для автоматического возврата соединения в пул после выхода из зоны видимости. Если автомат
+// защиты открыт, соединение не берется и guard пуст. Результат работы с соединением сообщается
+// автомату при возврате: ошибка контекста hiredis означает, что Redis не ответил
 class RedisConnectionGuard
 {
 public:
     RedisConnectionGuard();
     ~RedisConnectionGuard();
+    RedisConnectionGuard(const RedisConnectionGuard&) = delete;
+    RedisConnectionGuard& operator=(const RedisConnectionGuard&) = delete;
     operator redisContext* () { return conn; }
 
 private:
     redisContext* conn;
+    bool attempted; // Автомат пропустил обращение к Redis
 };
 
 RedisConnectionGuard connectRedis();
 
+// Задача, найденная в кэше
+struct CachedTask
+{
+    std::string etag;
+    std::string body; // Пустая строка, если задачи нет в кэше
+    bool stale = false; // Срок свежести истек, задачу можно отдать только пока она обновляется
+    bool missing = false; // Задачи нет или она принадлежит другому пользователю
+};
+
 std::string createCacheKey(int task_id, int user_id);
-crow::json::wvalue getTaskFromCache(int task_id, int user_id);
-void saveTaskInCache(int task_id, int user_id, const crow::json::wvalue& response);
-void saveTaskInCache(int task_id, int user_id, std::string task_name, std::string description
-    , std::string status_name, int priority, std::string due_date, std::vector<std::string> tags);
-void deleteTaskFromCache(int task_id, int user_id);
+CachedTask parseCachedTask(std::string_view value);
+std::pmr::string cachedTaskValue(std::string_view etag, std::string_view body, std::pmr::memory_resource* resource);
+std::string createTaskListVersionKey(int user_id);
 
 #endif 
@@ -0,0 +1,96 @@
+﻿#include "circuit_breaker.h"
+#include "crow_all.h"
+#include <algorithm>
+
+static long long steadyNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CircuitBreaker::CircuitBreaker(std::string name, int failureThreshold, std::chrono::milliseconds openTime, std::chrono::milliseconds maxOpenTime)
+    : name(std::move(name)), failureThreshold(failureThreshold), openTime(openTime), maxOpenTime(maxOpenTime) {}
+
+// В закрытом состоянии - одна атомарная загрузка. В открытом вызов пропускает только тот, кто первым
+// сдвинет retryAt: остальные отклоняются, пока пробный вызов не завершится. Если пробный вызов не
+// сообщил о результате, через maxOpenTime пропускается следующий
+bool CircuitBreaker::allow()
+{
+    if (state.load(std::memory_order_acquire) == State::Closed)
+        return true;
+
+    long long now = steadyNow();
+    long long retry = retryAt.load(std::memory_order_relaxed);
+    long long next = now + std::chrono::duration_cast<std::chrono::nanoseconds>(maxOpenTime).count();
+    if (now < retry || !retryAt.compare_exchange_strong(retry, next, std::memory_order_relaxed))
+    {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    state.store(State::HalfOpen, std::memory_order_release);
+    return true;
+}
+
+void CircuitBreaker::success()
+{
+    successes.fetch_add(1, std::memory_order_relaxed);
+    consecutiveFailures.store(0, std::memory_order_relaxed);
+
+    if (state.exchange(State::Closed, std::memory_order_acq_rel) != State::Closed)
+    {
+        trips.store(0, std::memory_order_relaxed);
+        CROW_LOG_WARNING << name << " circuit breaker closed";
+    }
+}
+
+void CircuitBreaker::failure()
+{
+    failures.fetch_add(1, std::memory_order_relaxed);
+    long long count = consecutiveFailures.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // Открыть автомат должен только один из потоков, иначе время открытия удвоится несколько раз
+    State current = state.load(std::memory_order_acquire);
+    if (current == State::HalfOpen && state.compare_exchange_strong(current, State::Open, std::memory_order_acq_rel))
+        trip();
+    else if (current == State::Closed && count >= failureThreshold
+        && state.compare_exchange_strong(current, State::Open, std::memory_order_acq_rel))
+        trip();
+}
+
+// Время открытия растет вдвое с каждым открытием подряд: openTime, 2 * openTime, ... до maxOpenTime
+void CircuitBreaker::trip()
+{
+    int n = std::min(trips.fetch_add(1, std::memory_order_relaxed), 20);
+    auto duration = std::min<std::chrono::milliseconds>(openTime * (1LL << n), maxOpenTime);
+    retryAt.store(steadyNow() + std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), std::memory_order_relaxed);
+    opened.fetch_add(1, std::memory_order_relaxed);
+    CROW_LOG_WARNING << name << " circuit breaker opened for " << duration.count() << " ms";
+}
+
+CircuitBreaker::Stats CircuitBreaker::stats() const
+{
+    Stats result;
+    result.state = state.load(std::memory_order_acquire);
+    result.consecutiveFailures = consecutiveFailures.load(std::memory_order_relaxed);
+    result.successes = successes.load(std::memory_order_relaxed);
+    result.failures = failures.load(std::memory_order_relaxed);
+    result.rejected = rejected.load(std::memory_order_relaxed);
+    result.opened = opened.load(std::memory_order_relaxed);
+    result.retryInMs = result.state == State::Closed ? 0
+        : std::max(0LL, (retryAt.load(std::memory_order_relaxed) - steadyNow()) / 1000000);
+    return result;
+}
+
+const char* stateName(CircuitBreaker::State state)
+{
+    switch (state)
+    {
+    case CircuitBreaker::State::Closed:
+        return "closed";
+    case CircuitBreaker::State::Open:
+        return "open";
+    default:
+        return "half_open";
+    }
+}
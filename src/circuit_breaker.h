@@ -0,0 +1,56 @@
+﻿#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Автомат защиты для необязательной зависимости. Пока ошибок меньше порога, вызовы проходят (Closed).
+// После failureThreshold ошибок подряд вызовы сразу отклоняются (Open), по истечении времени
+// пропускается один пробный вызов (HalfOpen): успех возвращает Closed, ошибка снова открывает
+// автомат на вдвое большее время, но не дольше maxOpenTime. Состояние - атомарные переменные,
+// поэтому проверка не берет блокировок и отклоненный вызов стоит несколько наносекунд
+class CircuitBreaker
+{
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    struct Stats
+    {
+        State state;
+        long long consecutiveFailures;
+        long long successes;
+        long long failures;
+        long long rejected; // Вызовов, отклоненных без обращения к зависимости
+        long long opened; // Сколько раз автомат открывался
+        long long retryInMs; // Через сколько будет пробный вызов, 0 если автомат закрыт
+    };
+
+    CircuitBreaker(std::string name, int failureThreshold, std::chrono::milliseconds openTime, std::chrono::milliseconds maxOpenTime);
+
+    bool allow(); // false - к зависимости обращаться не нужно
+    void success();
+    void failure();
+    Stats stats() const;
+
+private:
+    std::string name;
+    int failureThreshold;
+    std::chrono::milliseconds openTime;
+    std::chrono::milliseconds maxOpenTime;
+
+    std::atomic<State> state{ State::Closed };
+    std::atomic<long long> consecutiveFailures{ 0 };
+    std::atomic<int> trips{ 0 }; // Открытий подряд без успешного вызова, задает время следующего открытия
+    std::atomic<long long> retryAt{ 0 }; // Время пробного вызова, нс steady_clock
+    std::atomic<long long> successes{ 0 };
+    std::atomic<long long> failures{ 0 };
+    std::atomic<long long> rejected{ 0 };
+    std::atomic<long long> opened{ 0 };
+
+    void trip();
+};
+
+const char* stateName(CircuitBreaker::State state);
+
+#endif
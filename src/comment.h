@@ -3,13 +3,14 @@
 
 #include "crow_all.h"
 #include "database.h"
+#include "async_database.h"
 #include "auth.h"
 namespace comment
 {
-    crow::response addComment(const crow::request& req, int task_id);
-    crow::response getComments(const crow::request& req, int task_id);
-    crow::response updateComment(const crow::request& req, int task_id, int comment_id);
-    crow::response deleteComment(const crow::request& req, int task_id, int comment_id);
+    asio::awaitable<crow::response> addComment(const crow::request& req, int task_id);
+    asio::awaitable<crow::response> getComments(const crow::request& req, int task_id);
+    asio::awaitable<crow::response> updateComment(const crow::request& req, int task_id, int comment_id);
+    asio::awaitable<crow::response> deleteComment(const crow::request& req, int task_id, int comment_id);
 }
 
 #endif 
\ No newline at end of file
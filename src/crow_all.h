@@ -9779,7 +9779,9 @@ namespace crow
                 }
                 if (complete_request_handler_)
                 {
-                    complete_request_handler_();
+                    // The handler resets complete_request_handler_ while it runs; keep it alive until it returns.
+                    auto handler = std::move(complete_request_handler_);
+                    handler();
                     manual_length_header = false;
                     skip_body = false;
                 }
@@ -13376,7 +13378,13 @@ namespace crow
                 res.complete_request_handler_ = nullptr;
                 auto self = this->shared_from_this();
                 res.is_alive_helper_ = [self]() -> bool {
-                    return self->adaptor_.is_open();
+                    if (!self->adaptor_.is_open())
+                        return false;
+                    // No read is pending while the response is prepared asynchronously,
+                    // so check whether the peer has closed the connection in the meantime
+                    char byte;
+                    ssize_t received = ::recv(self->adaptor_.raw_socket().native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+                    return received > 0 || (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
                 };
 
                 detail::middleware_call_helper<detail::middleware_call_criteria_only_global,
@@ -13864,7 +13872,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
     {
     public:
         Server(Handler* handler, std::string bindaddr, uint16_t port, std::string server_name = std::string("Crow/") + VERSION, std::tuple<Middlewares...>* middlewares = nullptr, uint16_t concurrency = 1, uint8_t timeout = 5, typename Adaptor::context* adaptor_ctx = nullptr):
-          acceptor_(io_service_, tcp::endpoint(asio::ip::address::from_string(bindaddr), port)),
+          acceptor_(make_acceptor(io_service_, tcp::endpoint(asio::ip::address::from_string(bindaddr), port))),
           signals_(io_service_),
           tick_timer_(io_service_),
           handler_(handler),
@@ -13878,6 +13886,21 @@ namespace crow // NOTE: Already documented in "crow/app.h"
           adaptor_ctx_(adaptor_ctx)
         {}
 
+        /// Open, bind and listen. With CROW_ENABLE_REUSE_PORT several processes can listen on the same port
+        /// and the kernel balances incoming connections between them.
+        static tcp::acceptor make_acceptor(asio::io_service& io_service, const tcp::endpoint& endpoint)
+        {
+            tcp::acceptor acceptor(io_service);
+            acceptor.open(endpoint.protocol());
+            acceptor.set_option(tcp::acceptor::reuse_address(true));
+#ifdef CROW_ENABLE_REUSE_PORT
+            acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+            acceptor.bind(endpoint);
+            acceptor.listen();
+            return acceptor;
+        }
+
         void set_tick_function(std::chrono::milliseconds d, std::function<void()> f)
         {
             tick_interval_ = d;
@@ -10,16 +10,27 @@ ConnectionPool::ConnectionPool(const std::string& connStr, unsigned int minSize,
     }
 }
 
+static unsigned int poolMinSize = MIN_SIZE_POOL;
+static unsigned int poolMaxSize = MAX_SIZE_POOL;
+
 // Создание единственного экземпляра пула соединений
 ConnectionPool& ConnectionPool::getInstance()
 {
-    static ConnectionPool pool(CONNECTION_STRING, MIN_SIZE_POOL, MAX_SIZE_POOL);
+    static ConnectionPool pool(CONNECTION_STRING, poolMinSize, poolMaxSize);
     return pool;
 }
 
+// Размер пула, действует только до первого вызова getInstance
+void ConnectionPool::setSize(unsigned int minSize, unsigned int maxSize)
+{
+    poolMinSize = minSize;
+    poolMaxSize = maxSize;
+}
+
 // Взять соединение из пула
 std::shared_ptr<pqxx::connection> ConnectionPool::getConnection() 
 {
+    deadline::check();
     std::unique_lock<std::mutex> lock(mtx);
 
     if (connections.empty() && curSize < maxSize) 
@@ -28,7 +39,18 @@ std::shared_ptr<pqxx::connection> ConnectionPool::getConnection()
         ++curSize;
     }
 
-    poolWaiting.wait(lock, [this] { return !connections.empty(); });
+    // Запрос со сроком ждет соединения не дольше срока
+    auto available = [this] { return !connections.empty(); };
+    if (deadline::current)
+    {
+        if (!poolWaiting.wait_until(lock, deadline::current->at, available))
+        {
+            deadline::current->exceeded = true;
+            throw deadline::Expired();
+        }
+    }
+    else
+        poolWaiting.wait(lock, available);
 
     auto conn = connections.back();
     connections.pop_back();
@@ -4,15 +4,23 @@
 #include <pqxx/pqxx>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
+#include "slow_query.h"
+#include "deadline.h"
 
-const std::string CONNECTION_STRING = "dbname=taskManager user=postgres password=1234 host=db port=5432";
+// statement_timeout не дает запросу выполняться дольше любого срока запроса, даже если отмена не дошла
+const std::string CONNECTION_STRING = "dbname=taskManager user=postgres password=1234 host=db port=5432"
+    " options='-c statement_timeout=" + std::to_string(REQUEST_TIMEOUT_MS) + "'";
 const int MIN_SIZE_POOL = 3;
 const int MAX_SIZE_POOL = 10;
+const int MIN_SIZE_POOL_PER_CORE = 1; // В режиме по ядру пул у каждого процесса свой, поэтому меньше
+const int MAX_SIZE_POOL_PER_CORE = 3;
 
 class ConnectionPool 
 {
 public:
     static ConnectionPool& getInstance();
+    static void setSize(unsigned int minSize, unsigned int maxSize);
     std::shared_ptr<pqxx::connection> getConnection();
     void returnConnection(std::shared_ptr<pqxx::connection> conn);
     unsigned int availableConnections() const;
@@ -44,4 +52,26 @@ private:
 
 ConnectionGuard connectDB();
 
+// Выполнение запроса через pqxx с замером времени. Медленное выполнение записывается в журнал
+// под именем name, параметры переводятся в текст только в этом случае. Запрос с истекшим сроком не выполняется
+template <typename... Args>
+pqxx::result execTimed(pqxx::transaction_base& txn, const std::string& name, const std::string& query, const Args&... args)
+{
+    deadline::check();
+    auto start = slowquery::Clock::now();
+    pqxx::result result;
+    if constexpr (sizeof...(Args) == 0)
+        result = txn.exec(query); // Без параметров - простой протокол, как и раньше
+    else
+        result = txn.exec_params(query, args...);
+    auto elapsed = slowquery::Clock::now() - start;
+
+    if (slowquery::isSlow(elapsed))
+    {
+        slowquery::Params params{ std::optional<std::string>(pqxx::to_string(args))... };
+        slowquery::report(name, { query }, { std::move(params) }, result.affected_rows(), elapsed);
+    }
+    return result;
+}
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,24 @@
+﻿#include "deadline.h"
+#include "crow_all.h"
+#include <algorithm>
+#include <charconv>
+
+namespace deadline
+{
+    // Срок запроса: REQUEST_TIMEOUT_MS или меньший, если клиент передал X-Request-Timeout.
+    // Неверное значение заголовка не считается ошибкой запроса, используется срок по умолчанию
+    std::shared_ptr<Deadline> create(const crow::request& req, crow::response& res)
+    {
+        int timeout = REQUEST_TIMEOUT_MS;
+        const std::string& header = req.get_header_value(REQUEST_TIMEOUT_HEADER);
+        int requested = 0;
+        auto [end, error] = std::from_chars(header.data(), header.data() + header.size(), requested);
+        if (error == std::errc() && end == header.data() + header.size() && requested > 0)
+            timeout = std::min(requested, REQUEST_TIMEOUT_MS);
+
+        auto result = std::make_shared<Deadline>();
+        result->at = Clock::now() + std::chrono::milliseconds(timeout);
+        result->clientGone = [&res] { return !res.is_alive(); };
+        return result;
+    }
+}
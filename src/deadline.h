@@ -0,0 +1,70 @@
+﻿#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+const int REQUEST_TIMEOUT_MS = 5000; // Срок запроса по умолчанию и наибольший срок, который может задать клиент
+const int DEADLINE_CHECK_INTERVAL_MS = 50; // Как часто ожидание проверяет, не закрыл ли клиент соединение
+const char* const REQUEST_TIMEOUT_HEADER = "X-Request-Timeout"; // Срок запроса в мс, задается клиентом
+
+namespace crow
+{
+    struct request;
+    struct response;
+}
+
+// Срок запроса. Ожидание соединения из пула, обращения к Redis и запросы к бд проверяют срок текущего
+// запроса потока (current) и прекращают работу, если срок истек или клиент закрыл соединение.
+// Синхронный участок запроса выставляет current в AccessLogMiddleware, корутина - своим исполнителем
+namespace deadline
+{
+    using Clock = std::chrono::steady_clock;
+
+    class Expired : public std::runtime_error
+    {
+    public:
+        Expired() : std::runtime_error("Request deadline exceeded") {}
+    };
+
+    struct Deadline
+    {
+        Clock::time_point at;
+        std::function<bool()> clientGone; // Может быть пустой
+        bool exceeded = false; // Работа запроса прервана по сроку, ответ будет 504
+
+        // Истек ли срок. Запоминается, чтобы ответ запроса получил код 504
+        bool expired()
+        {
+            if (!exceeded && (Clock::now() >= at || (clientGone && clientGone())))
+                exceeded = true;
+            return exceeded;
+        }
+
+        // Когда проверить срок в следующий раз: закрытие соединения клиентом видно только при проверке
+        Clock::time_point nextCheck() const
+        {
+            return std::min(at, Clock::now() + std::chrono::milliseconds(DEADLINE_CHECK_INTERVAL_MS));
+        }
+    };
+
+    inline thread_local Deadline* current = nullptr;
+
+    inline bool expired()
+    {
+        return current && current->expired();
+    }
+
+    inline void check()
+    {
+        if (expired())
+            throw Expired();
+    }
+
+    std::shared_ptr<Deadline> create(const crow::request& req, crow::response& res);
+}
+
+#endif
@@ -0,0 +1,154 @@
+﻿#include "debug.h"
+#include <cstdlib>
+
+namespace debug
+{
+    // Токен читается один раз. Без него отладочные маршруты отвечают 404, как будто их нет
+    bool checkDebugToken(const crow::request& req)
+    {
+        static const char* token = std::getenv(DEBUG_TOKEN_ENV);
+        if (!token || !*token)
+            return false;
+
+        const std::string& header = req.get_header_value("X-Debug-Token");
+        return !header.empty() && header == token;
+    }
+
+    // Профилирование на seconds секунд: mode=cpu (по умолчанию) или mode=alloc, для alloc
+    // weight=bytes (по умолчанию) или weight=count. Ответ - свернутые стеки для flamegraph.pl.
+    // В режиме по ядру профилируется только процесс, который принял запрос
+    asio::awaitable<crow::response> profile(const crow::request& req)
+    {
+        bool profiling = false;
+        try
+        {
+            if (!checkDebugToken(req))
+                co_return crow::response(404);
+
+            crow::query_string qs(req.url_params);
+            int seconds = qs.get("seconds") ? std::stoi(qs.get("seconds")) : PROFILE_DEFAULT_SECONDS;
+            if (seconds < 1 || seconds > PROFILE_MAX_SECONDS)
+                co_return crow::response(400, "seconds must be between 1 and " + std::to_string(PROFILE_MAX_SECONDS));
+
+            std::string modeName = qs.get("mode") ? qs.get("mode") : "cpu";
+            std::string weightName = qs.get("weight") ? qs.get("weight") : "bytes";
+            profiler::Mode mode;
+            profiler::Weight weight;
+            if (modeName == "cpu")
+            {
+                mode = profiler::Mode::Cpu;
+                weight = profiler::Weight::Samples;
+            }
+            else if (modeName == "alloc" && (weightName == "bytes" || weightName == "count"))
+            {
+                mode = profiler::Mode::Alloc;
+                weight = weightName == "bytes" ? profiler::Weight::Bytes : profiler::Weight::Count;
+            }
+            else
+                co_return crow::response(400, "Unknown mode or weight");
+
+            if (!profiler::start(mode))
+                co_return crow::response(409, "Profiling is already running");
+            profiling = true;
+
+            // Поток не блокируется: пока идет сбор, он обслуживает запросы, которые и профилируются
+            asio::steady_timer timer(co_await asio::this_coro::executor, std::chrono::seconds(seconds));
+            co_await timer.async_wait(asio::use_awaitable);
+
+            auto result = profiler::stop(weight);
+            profiling = false;
+            crow::response response(200, result.folded);
+            response.set_header("Content-Type", "text/plain");
+            response.set_header("X-Profile-Samples", std::to_string(result.samples));
+            response.set_header("X-Profile-Dropped", std::to_string(result.dropped));
+            co_return response;
+        }
+        catch (const std::exception& e)
+        {
+            if (profiling)
+                profiler::stop(profiler::Weight::Samples);
+            co_return crow::response(400, e.what());
+        }
+    }
+
+    // Сводка выделений памяти по маршрутам с момента запуска или последнего сброса: средние
+    // за запрос и наибольшие значения. В режиме по ядру - только процесса, который принял запрос
+    crow::response allocations(const crow::request& req)
+    {
+        if (!checkDebugToken(req))
+            return crow::response(404);
+
+        crow::json::wvalue response;
+        response["routes"] = crow::json::wvalue::object();
+        for (const auto& [route, stats] : allocstats::routes())
+        {
+            auto& item = response["routes"][route];
+            item["requests"] = stats.requests;
+            item["allocations_per_request"] = stats.allocations / stats.requests;
+            item["bytes_per_request"] = stats.bytes / stats.requests;
+            item["max_allocations"] = stats.maxAllocations;
+            item["max_bytes"] = stats.maxBytes;
+            item["max_peak_bytes"] = stats.maxPeak;
+        }
+        return crow::response(200, response);
+    }
+
+    crow::response resetAllocations(const crow::request& req)
+    {
+        if (!checkDebugToken(req))
+            return crow::response(404);
+
+        allocstats::reset();
+        return crow::response(200, "Allocation statistics reset");
+    }
+
+    // Автомат защиты Redis и синхронный пул соединений процесса, который принял запрос
+    crow::response redis(const crow::request& req)
+    {
+        if (!checkDebugToken(req))
+            return crow::response(404);
+
+        auto stats = redisCircuitBreaker().stats();
+        auto& pool = RedisConnectionPool::getInstance();
+        crow::json::wvalue response;
+        response["state"] = stateName(stats.state);
+        response["consecutive_failures"] = stats.consecutiveFailures;
+        response["successes"] = stats.successes;
+        response["failures"] = stats.failures;
+        response["rejected"] = stats.rejected;
+        response["opened"] = stats.opened;
+        response["retry_in_ms"] = stats.retryInMs;
+        response["pool_available"] = pool.availableConnections();
+        response["pool_active"] = pool.activeConnections();
+        return crow::response(200, response);
+    }
+
+    // Пределы одновременных запросов по классам маршрутов и пользователям, ограничение частоты
+    crow::response admission(const crow::request& req)
+    {
+        if (!checkDebugToken(req))
+            return crow::response(404);
+
+        crow::json::wvalue response;
+        for (auto routeClass : { admission::RouteClass::Auth, admission::RouteClass::Read, admission::RouteClass::Write })
+        {
+            auto stats = admission::limiter(routeClass).stats();
+            auto& item = response[admission::className(routeClass)];
+            item["limit"] = stats.limit;
+            item["inflight"] = stats.inflight;
+            item["accepted"] = stats.accepted;
+            item["rejected"] = stats.rejected;
+            item["short_rtt_ms"] = stats.shortRttMs;
+            item["long_rtt_ms"] = stats.longRttMs;
+        }
+        response["users"]["active"] = fairness::userCounters().activeUsers();
+        response["users"]["rejected"] = fairness::userCounters().rejected();
+
+        auto rateLimits = ratelimit::Limiter::getInstance().stats();
+        response["rate_limit"]["buckets"] = rateLimits.buckets;
+        response["rate_limit"]["rejected"] = rateLimits.rejected;
+        response["rate_limit"]["syncs"] = rateLimits.syncs;
+        response["rate_limit"]["sync_failures"] = rateLimits.syncFailures;
+        return crow::response(200, response);
+    }
+}
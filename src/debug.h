@@ -0,0 +1,28 @@
+﻿#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "crow_all.h"
+#include "async_pool.h"
+#include "profiler.h"
+#include "alloc_stats.h"
+#include "cache.h"
+#include "admission.h"
+#include "fairness.h"
+#include "rate_limit.h"
+
+const char* const DEBUG_TOKEN_ENV = "DEBUG_TOKEN"; // Переменная окружения с токеном отладочных маршрутов
+const int PROFILE_DEFAULT_SECONDS = 10;
+
+// Отладочные маршруты. Доступны, только если задан DEBUG_TOKEN, и требуют его в заголовке X-Debug-Token
+namespace debug
+{
+    bool checkDebugToken(const crow::request& req);
+
+    asio::awaitable<crow::response> profile(const crow::request& req);
+    crow::response allocations(const crow::request& req);
+    crow::response resetAllocations(const crow::request& req);
+    crow::response redis(const crow::request& req);
+    crow::response admission(const crow::request& req);
+}
+
+#endif
@@ -0,0 +1,256 @@
+﻿#include "dictionary.h"
+
+Dictionaries::Dictionaries()
+    : statuses(std::make_shared<const std::unordered_map<int, std::string>>()), tags(std::make_shared<const TagMap>())
+{
+    auto db = connectDB();
+    pqxx::nontransaction txn(db);
+
+    loadStatuses(txn);
+
+    std::vector<std::pair<int, std::string>> allTags;
+    for (const auto& row : execTimed(txn, "load_tags", "SELECT tag_id, tag_name FROM tags"))
+        allTags.emplace_back(row[0].as<int>(), row[1].as<std::string>());
+    addTags(allTags);
+}
+
+// Получение единственного экземпляра справочников, при первом вызове загружает их из бд
+Dictionaries& Dictionaries::getInstance()
+{
+    static Dictionaries dictionaries;
+    return dictionaries;
+}
+
+// Загрузка всех статусов
+void Dictionaries::loadStatuses(pqxx::transaction_base& txn)
+{
+    auto loaded = std::make_shared<std::unordered_map<int, std::string>>();
+    for (const auto& row : execTimed(txn, "load_statuses", "SELECT status_id, status_name FROM task_statuses"))
+        (*loaded)[row[0].as<int>()] = row[1].as<std::string>();
+    setStatuses(std::move(loaded));
+}
+
+void Dictionaries::setStatuses(std::shared_ptr<std::unordered_map<int, std::string>> loaded)
+{
+    std::lock_guard<std::mutex> lock(writeMtx);
+    std::atomic_store(&statuses, std::shared_ptr<const std::unordered_map<int, std::string>>(std::move(loaded)));
+}
+
+// Название статуса. Неизвестный статус (добавлен после загрузки) перечитывается из бд
+std::string Dictionaries::statusName(pqxx::transaction_base& txn, int status_id)
+{
+    auto current = std::atomic_load(&statuses);
+    auto it = current->find(status_id);
+    if (it != current->end())
+        return it->second;
+    if (status_id <= 0) // У задачи нет статуса
+        return std::string();
+
+    loadStatuses(txn);
+
+    current = std::atomic_load(&statuses);
+    it = current->find(status_id);
+    return it != current->end() ? it->second : std::string();
+}
+
+// Название статуса для обработчиков без транзакции pqxx. Соединение из пула берется, только если
+// статус нужно дочитать из бд, это редкий случай, поэтому он может ненадолго заблокировать поток
+std::string Dictionaries::statusName(int status_id)
+{
+    auto current = std::atomic_load(&statuses);
+    auto it = current->find(status_id);
+    if (it != current->end())
+        return it->second;
+    if (status_id <= 0)
+        return std::string();
+
+    auto db = connectDB();
+    pqxx::nontransaction txn(db);
+    return statusName(txn, status_id);
+}
+
+// id тега по названию, -1 если тега нет в справочнике
+int Dictionaries::tagId(const std::string& tag_name)
+{
+    auto current = std::atomic_load(&tags);
+    auto it = current->ids.find(tag_name);
+    return it != current->ids.end() ? it->second : -1;
+}
+
+// Названия тегов по id. Теги, созданные другими экземплярами сервера, дочитываются из бд одним запросом
+std::vector<std::string> Dictionaries::tagNames(pqxx::transaction_base& txn, const std::vector<int>& tag_ids)
+{
+    std::vector<std::string> names;
+    names.reserve(tag_ids.size());
+
+    auto current = std::atomic_load(&tags);
+    std::vector<int> missing;
+    for (int id : tag_ids)
+    {
+        if (!current->names.count(id))
+            missing.push_back(id);
+    }
+
+    if (!missing.empty())
+    {
+        std::vector<std::pair<int, std::string>> loaded;
+        for (const auto& row : execTimed(txn, "load_tags_by_id", "SELECT tag_id, tag_name FROM tags WHERE tag_id = ANY($1)", missing))
+            loaded.emplace_back(row[0].as<int>(), row[1].as<std::string>());
+        addTags(loaded);
+        current = std::atomic_load(&tags);
+    }
+
+    for (int id : tag_ids)
+    {
+        auto it = current->names.find(id);
+        if (it != current->names.end())
+            names.push_back(it->second);
+    }
+
+    return names;
+}
+
+// Названия тегов для обработчиков без транзакции pqxx, соединение берется только для неизвестных тегов
+std::vector<std::string> Dictionaries::tagNames(const std::vector<int>& tag_ids)
+{
+    auto current = std::atomic_load(&tags);
+    bool known = true;
+    for (int id : tag_ids)
+        known = known && current->names.count(id);
+
+    if (known)
+    {
+        std::vector<std::string> names;
+        names.reserve(tag_ids.size());
+        for (int id : tag_ids)
+            names.push_back(current->names.at(id));
+        return names;
+    }
+
+    auto db = connectDB();
+    pqxx::nontransaction txn(db);
+    return tagNames(txn, tag_ids);
+}
+
+// Добавление тегов в справочник. Вызывается только для тегов, которые уже есть в бд (после commit)
+void Dictionaries::addTags(const std::vector<std::pair<int, std::string>>& added)
+{
+    if (added.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(writeMtx);
+
+    auto updated = std::make_shared<TagMap>(*std::atomic_load(&tags));
+    for (const auto& [id, name] : added)
+    {
+        updated->names[id] = name;
+        updated->ids[name] = id;
+    }
+
+    std::atomic_store(&tags, std::shared_ptr<const TagMap>(std::move(updated)));
+}
+
+Dictionaries::Snapshot Dictionaries::snapshot()
+{
+    Snapshot current;
+    current.statuses = std::atomic_load(&statuses);
+    current.tags = std::atomic_load(&tags);
+    return current;
+}
+
+// Снимок, в котором есть все перечисленные статусы и теги. Статусы и теги, добавленные после загрузки
+// (например, другим экземпляром сервера), дочитываются через неблокирующее соединение
+asio::awaitable<Dictionaries::Snapshot> Dictionaries::snapshotFor(std::vector<int> status_ids, std::vector<int> tag_ids)
+{
+    Snapshot current = snapshot();
+    bool statusesKnown = std::all_of(status_ids.begin(), status_ids.end(), [&current](int id) { return current.hasStatus(id); });
+    std::erase_if(tag_ids, [&current](int id) { return current.hasTag(id); });
+    if (statusesKnown && tag_ids.empty())
+        co_return current;
+
+    if (!statusesKnown)
+    {
+        auto result = co_await asyncQuery("load_statuses", "SELECT status_id, status_name FROM task_statuses");
+        auto loaded = std::make_shared<std::unordered_map<int, std::string>>();
+        for (int i = 0; i != result.size(); ++i)
+            (*loaded)[static_cast<int>(result.integer(i, "status_id"))] = result.text(i, "status_name");
+        setStatuses(std::move(loaded));
+    }
+
+    if (!tag_ids.empty())
+    {
+        auto result = co_await asyncQuery("load_tags_by_id", "SELECT tag_id, tag_name FROM tags WHERE tag_id = ANY($1)", tag_ids);
+        std::vector<std::pair<int, std::string>> loaded;
+        for (int i = 0; i != result.size(); ++i)
+            loaded.emplace_back(static_cast<int>(result.integer(i, "tag_id")), result.text(i, "tag_name"));
+        addTags(loaded);
+    }
+
+    co_return snapshot();
+}
+
+Dictionaries::Snapshot Dictionaries::Snapshot::fromLists(const std::vector<std::pair<int, std::string>>& statuses,
+    const std::vector<std::pair<int, std::string>>& tags)
+{
+    auto statusMap = std::make_shared<std::unordered_map<int, std::string>>(statuses.begin(), statuses.end());
+    auto tagMap = std::make_shared<TagMap>();
+    for (const auto& [id, name] : tags)
+    {
+        tagMap->names[id] = name;
+        tagMap->ids[name] = id;
+    }
+
+    Snapshot snapshot;
+    snapshot.statuses = std::move(statusMap);
+    snapshot.tags = std::move(tagMap);
+    return snapshot;
+}
+
+std::string_view Dictionaries::Snapshot::statusName(int status_id)
+{
+    auto it = statuses->find(status_id);
+    if (it != statuses->end())
+        return it->second;
+    if (status_id <= 0)
+        return std::string_view();
+
+    auto& dictionaries = Dictionaries::getInstance();
+    dictionaries.statusName(status_id);
+    statuses = std::atomic_load(&dictionaries.statuses);
+
+    it = statuses->find(status_id);
+    return it != statuses->end() ? std::string_view(it->second) : std::string_view();
+}
+
+// У задачи без статуса (status_id NULL) название пустое, дочитывать нечего
+bool Dictionaries::Snapshot::hasStatus(int status_id) const
+{
+    return status_id <= 0 || statuses->count(status_id);
+}
+
+bool Dictionaries::Snapshot::hasTag(int tag_id) const
+{
+    return tags->names.count(tag_id);
+}
+
+const std::string* Dictionaries::Snapshot::tagName(int tag_id)
+{
+    auto it = tags->names.find(tag_id);
+    if (it != tags->names.end())
+        return &it->second;
+
+    auto& dictionaries = Dictionaries::getInstance();
+    dictionaries.tagNames(std::vector<int>{ tag_id });
+    tags = std::atomic_load(&dictionaries.tags);
+
+    it = tags->names.find(tag_id);
+    return it != tags->names.end() ? &it->second : nullptr;
+}
+
+// Разбор массива Postgres из целых чисел вида {1,2,3}
+std::vector<int> parseIdArray(std::string_view array)
+{
+    std::vector<int> ids;
+    forEachId(array, [&ids](int id) { ids.push_back(id); });
+    return ids;
+}
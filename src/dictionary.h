@@ -0,0 +1,96 @@
+﻿#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <pqxx/pqxx>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "database.h"
+#include "async_database.h"
+
+// Справочники статусов и тегов. Загружаются при старте, читаются без блокировок: читатель берет
+// текущий неизменяемый снимок, писатель копирует снимок, дополняет его и публикует новый
+class Dictionaries
+{
+    struct TagMap;
+
+public:
+    // Снимок справочников для сборки ответа: названия отдаются без копирования, пока снимок жив.
+    // Неизвестный id дочитывается из бд, после чего снимок обновляется. Обработчики запросов берут
+    // снимок через snapshotFor, в котором уже есть все нужные id, чтобы не блокировать поток
+    class Snapshot
+    {
+    public:
+        std::string_view statusName(int status_id);
+        const std::string* tagName(int tag_id); // nullptr, если тега нет и в бд
+        bool hasStatus(int status_id) const;
+        bool hasTag(int tag_id) const;
+
+        // Снимок из готовых списков, без обращения к бд (для бенчмарков)
+        static Snapshot fromLists(const std::vector<std::pair<int, std::string>>& statuses,
+            const std::vector<std::pair<int, std::string>>& tags);
+
+    private:
+        friend class Dictionaries;
+        std::shared_ptr<const std::unordered_map<int, std::string>> statuses;
+        std::shared_ptr<const TagMap> tags;
+    };
+
+    static Dictionaries& getInstance();
+
+    std::string statusName(pqxx::transaction_base& txn, int status_id);
+    std::string statusName(int status_id);
+    int tagId(const std::string& tag_name);
+    std::vector<std::string> tagNames(pqxx::transaction_base& txn, const std::vector<int>& tag_ids);
+    std::vector<std::string> tagNames(const std::vector<int>& tag_ids);
+    void addTags(const std::vector<std::pair<int, std::string>>& tags);
+    Snapshot snapshot();
+    asio::awaitable<Snapshot> snapshotFor(std::vector<int> status_ids, std::vector<int> tag_ids);
+
+private:
+    Dictionaries();
+
+    struct TagMap
+    {
+        std::unordered_map<int, std::string> names;
+        std::unordered_map<std::string, int> ids;
+    };
+
+    std::shared_ptr<const std::unordered_map<int, std::string>> statuses;
+    std::shared_ptr<const TagMap> tags;
+    std::mutex writeMtx;
+
+    void loadStatuses(pqxx::transaction_base& txn);
+    void setStatuses(std::shared_ptr<std::unordered_map<int, std::string>> loaded);
+};
+
+// Обход массива Postgres из целых чисел вида {1,2,3} без выделения памяти
+template <typename Visitor>
+void forEachId(std::string_view array, Visitor visit)
+{
+    int value = 0;
+    bool inNumber = false;
+
+    for (char c : array)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            value = value * 10 + (c - '0');
+            inNumber = true;
+        }
+        else if (inNumber)
+        {
+            visit(value);
+            value = 0;
+            inNumber = false;
+        }
+    }
+}
+
+std::vector<int> parseIdArray(std::string_view array);
+
+#endif
@@ -0,0 +1,62 @@
+﻿#include "etag.h"
+
+namespace etag
+{
+    // ETag задачи строится из id и версии строки tasks.version, которую увеличивает триггер
+    std::string forTask(int task_id, long long version)
+    {
+        return "\"t" + std::to_string(task_id) + "-" + std::to_string(version) + "\"";
+    }
+
+    // ETag списка задач строится из версии users.tasks_version, которая увеличивается при каждой записи
+    std::string forTaskList(int user_id, long long version)
+    {
+        return "\"u" + std::to_string(user_id) + "-" + std::to_string(version) + "\"";
+    }
+
+    // Проверка заголовка If-None-Match: "*" или список ETag через запятую
+    bool matches(const crow::request& req, const std::string& etag)
+    {
+        const std::string& header = req.get_header_value("If-None-Match");
+        if (header.empty() || etag.empty())
+            return false;
+
+        size_t pos = 0;
+        while (pos < header.size())
+        {
+            size_t end = header.find(',', pos);
+            if (end == std::string::npos)
+                end = header.size();
+
+            size_t begin = header.find_first_not_of(' ', pos);
+            size_t last = header.find_last_not_of(' ', end - 1);
+
+            if (begin != std::string::npos && begin < end && last >= begin)
+            {
+                std::string_view candidate(header.data() + begin, last - begin + 1);
+
+                if (candidate == "*")
+                    return true;
+
+                // Для If-None-Match используется слабое сравнение, поэтому префикс W/ игнорируется
+                if (candidate.starts_with("W/"))
+                    candidate.remove_prefix(2);
+
+                if (candidate == etag)
+                    return true;
+            }
+
+            pos = end + 1;
+        }
+
+        return false;
+    }
+
+    // Ответ 304 без тела
+    crow::response notModified(const std::string& etag)
+    {
+        crow::response response(304);
+        response.set_header("ETag", etag);
+        return response;
+    }
+}
@@ -0,0 +1,16 @@
+﻿#ifndef ETAG_H
+#define ETAG_H
+
+#include "crow_all.h"
+#include <string>
+
+namespace etag
+{
+    std::string forTask(int task_id, long long version);
+    std::string forTaskList(int user_id, long long version);
+
+    bool matches(const crow::request& req, const std::string& etag);
+    crow::response notModified(const std::string& etag);
+}
+
+#endif
@@ -0,0 +1,45 @@
+﻿#include "fairness.h"
+
+namespace fairness
+{
+    bool UserCounters::tryAcquire(int user_id, int limit)
+    {
+        Shard& part = shard(user_id);
+        std::lock_guard<std::mutex> lock(part.mtx);
+        int& count = part.counts[user_id];
+        if (count >= limit)
+        {
+            rejectedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        ++count;
+        return true;
+    }
+
+    void UserCounters::release(int user_id)
+    {
+        Shard& part = shard(user_id);
+        std::lock_guard<std::mutex> lock(part.mtx);
+        auto it = part.counts.find(user_id);
+        if (it != part.counts.end() && --it->second == 0)
+            part.counts.erase(it);
+    }
+
+    // Пользователей, у которых сейчас есть запросы
+    size_t UserCounters::activeUsers()
+    {
+        size_t result = 0;
+        for (auto& part : shards)
+        {
+            std::lock_guard<std::mutex> lock(part.mtx);
+            result += part.counts.size();
+        }
+        return result;
+    }
+
+    UserCounters& userCounters()
+    {
+        static UserCounters counters;
+        return counters;
+    }
+}
@@ -0,0 +1,123 @@
+﻿#ifndef FAIRNESS_H
+#define FAIRNESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+const int USER_MAX_CONCURRENT = 16; // Одновременных запросов одного пользователя в процессе, остальные получают 429
+const int USER_COUNTER_SHARDS = 64; // Частей таблицы счетчиков, у каждой своя блокировка
+const int USER_RETRY_AFTER_SECONDS = 1;
+
+// Справедливость между пользователями: ограничение числа одновременных запросов пользователя и
+// честная очередь к общим ресурсам (соединениям пулов), в которой пользователь с множеством
+// ожидающих запросов не обгоняет остальных
+namespace fairness
+{
+    // Пользователь текущего запроса потока, 0 - запрос без токена. Выставляется так же, как deadline::current
+    inline thread_local int currentUser = 0;
+
+    // Счетчики запросов пользователей. Пользователь попадает в одну часть по id, поэтому запросы
+    // разных пользователей почти никогда не берут одну блокировку. Запись удаляется, когда у
+    // пользователя не остается запросов, и таблица не растет с числом пользователей
+    class UserCounters
+    {
+    public:
+        bool tryAcquire(int user_id, int limit);
+        void release(int user_id);
+        long long rejected() const { return rejectedCount.load(std::memory_order_relaxed); }
+        size_t activeUsers();
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::mutex mtx;
+            std::unordered_map<int, int> counts;
+        };
+
+        Shard shards[USER_COUNTER_SHARDS];
+        std::atomic<long long> rejectedCount{ 0 };
+
+        Shard& shard(int user_id) { return shards[static_cast<unsigned int>(user_id) % USER_COUNTER_SHARDS]; }
+    };
+
+    UserCounters& userCounters();
+
+    // Вес пользователя в очереди: доля обслуживания пропорциональна весу. Веса по пользователям не
+    // реализованы, у всех вес 1, запросы без токена делят один вес на всех. Точка расширения для
+    // приоритетных пользователей, поэтому id принимается, но не используется
+    inline double weight(int /* user_id */)
+    {
+        return 1.0;
+    }
+
+    // Честная очередь с метками начала (start-time fair queuing). Элемент получает метку окончания
+    // max(виртуальное время, метка предыдущего элемента пользователя) + 1 / вес и извлекается в
+    // порядке меток, поэтому пользователи с ожидающими элементами обслуживаются по очереди, сколько
+    // бы элементов ни поставил каждый. Не потокобезопасна, как и пул, который ее использует
+    template <typename Item>
+    class FairQueue
+    {
+    public:
+        void push(int user_id, Item item)
+        {
+            double& last = lastFinish[user_id];
+            double start = std::max(virtualTime, last);
+            last = start + 1.0 / weight(user_id);
+            items.push_back({ start, last, sequence++, std::move(item) });
+        }
+
+        bool empty() const { return items.empty(); }
+        size_t size() const { return items.size(); }
+
+        Item pop()
+        {
+            auto next = std::min_element(items.begin(), items.end(), [](const Entry& a, const Entry& b)
+                {
+                    return a.finish < b.finish || (a.finish == b.finish && a.sequence < b.sequence);
+                });
+            Item item = std::move(next->item);
+            virtualTime = next->start;
+            items.erase(next);
+            prune();
+            return item;
+        }
+
+        // Удаление элемента, который больше не ждет (например, по сроку запроса)
+        bool erase(const Item& item)
+        {
+            auto found = std::find_if(items.begin(), items.end(), [&item](const Entry& entry) { return entry.item == item; });
+            if (found == items.end())
+                return false;
+            items.erase(found);
+            return true;
+        }
+
+    private:
+        struct Entry
+        {
+            double start;
+            double finish;
+            unsigned long long sequence; // Равные метки извлекаются в порядке постановки
+            Item item;
+        };
+
+        std::vector<Entry> items; // Ожидающих немного, поэтому поиск линейный
+        std::unordered_map<int, double> lastFinish;
+        double virtualTime = 0;
+        unsigned long long sequence = 0;
+
+        // Метки пользователей, которые отстали от виртуального времени, больше ни на что не влияют
+        void prune()
+        {
+            if (lastFinish.size() <= 2 * items.size() + 64)
+                return;
+            for (auto it = lastFinish.begin(); it != lastFinish.end();)
+                it = it->second <= virtualTime ? lastFinish.erase(it) : std::next(it);
+        }
+    };
+}
+
+#endif
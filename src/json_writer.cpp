@@ -0,0 +1,98 @@
+﻿#include "json_writer.h"
+#include <charconv>
+
+JsonWriter::JsonWriter(std::pmr::memory_resource* resource) : out(resource), needComma(false) {}
+
+void JsonWriter::separator()
+{
+    if (needComma)
+        out += ',';
+}
+
+void JsonWriter::beginObject()
+{
+    separator();
+    out += '{';
+    needComma = false;
+}
+
+void JsonWriter::endObject()
+{
+    out += '}';
+    needComma = true;
+}
+
+void JsonWriter::beginArray()
+{
+    separator();
+    out += '[';
+    needComma = false;
+}
+
+void JsonWriter::endArray()
+{
+    out += ']';
+    needComma = true;
+}
+
+void JsonWriter::key(std::string_view name)
+{
+    separator();
+    out += '"';
+    escape(name);
+    out += "\":";
+    needComma = false;
+}
+
+void JsonWriter::value(std::string_view text)
+{
+    separator();
+    out += '"';
+    escape(text);
+    out += '"';
+    needComma = true;
+}
+
+void JsonWriter::value(long long number)
+{
+    separator();
+    char buffer[24];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+    out.append(buffer, end);
+    needComma = true;
+}
+
+void JsonWriter::null()
+{
+    separator();
+    out += "null";
+    needComma = true;
+}
+
+void JsonWriter::escape(std::string_view text)
+{
+    const char* hex = "0123456789abcdef";
+    for (char c : text)
+    {
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c >= 0 && c < 0x20)
+                {
+                    out += "\\u00";
+                    out += hex[c / 16];
+                    out += hex[c % 16];
+                }
+                else
+                    out += c;
+                break;
+        }
+    }
+}
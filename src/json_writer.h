@@ -0,0 +1,36 @@
+﻿#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+// Потоковая запись JSON в строку на арене запроса. В отличие от crow::json::wvalue не создает
+// узел и копию строки на каждое поле: значения сразу дописываются в итоговый текст.
+// Экранирование строк такое же, как в crow::json, поэтому ответы и записи кэша совпадают
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::pmr::memory_resource* resource);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(std::string_view name);
+    void value(std::string_view text);
+    void value(long long number);
+    void null(); // Значение null, например для NULL из бд
+
+    void reserve(size_t size) { out.reserve(size); }
+    const std::pmr::string& str() const { return out; }
+
+private:
+    std::pmr::string out;
+    bool needComma; // Перед следующим значением нужна запятая
+
+    void separator();
+    void escape(std::string_view text);
+};
+
+#endif
@@ -0,0 +1,125 @@
+﻿#include "percore.h"
+
+namespace
+{
+    std::vector<pid_t> workerPids;
+    volatile std::sig_atomic_t stopping = 0;
+
+    // Остановка: сигнал пересылается всем процессам, Crow в каждом из них завершает работу сам
+    void stopWorkers(int signal)
+    {
+        stopping = 1;
+        for (pid_t pid : workerPids)
+        {
+            if (pid > 0)
+                kill(pid, signal);
+        }
+    }
+
+    // Запуск процесса, закрепленного за ядром. Процесс создается до того, как появились потоки и
+    // соединения, поэтому все синглтоны (пулы, фильтр задач, справочники) у каждого процесса свои
+    pid_t startWorker(unsigned int index, const std::function<void()>& runWorker, const sigset_t& mask)
+    {
+        pid_t pid = fork();
+        if (pid != 0)
+            return pid;
+
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+
+        try
+        {
+            runWorker();
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "Worker %u failed: %s\n", index, e.what());
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    // Запуск процесса с записью его pid. До записи сигналы остановки заблокированы, иначе stopWorkers
+    // не узнал бы о новом процессе. Сигнал, пришедший до блокировки, виден по stopping
+    pid_t spawnWorker(unsigned int index, const std::function<void()>& runWorker)
+    {
+        sigset_t stopSignals;
+        sigset_t previous;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+
+        sigprocmask(SIG_BLOCK, &stopSignals, &previous);
+        workerPids[index] = startWorker(index, runWorker, previous);
+        sigprocmask(SIG_SETMASK, &previous, nullptr);
+
+        if (stopping && workerPids[index] > 0)
+            kill(workerPids[index], SIGTERM);
+        return workerPids[index];
+    }
+}
+
+// Режим по ядру: workers процессов слушают один порт (SO_REUSEPORT), ядро ОС распределяет между ними
+// соединения. Родительский процесс только перезапускает упавшие процессы и передает им сигналы остановки
+int runPerCore(unsigned int workers, const std::function<void()>& runWorker)
+{
+#ifndef CROW_ENABLE_REUSE_PORT
+    (void)workers;
+    (void)runWorker;
+    std::fprintf(stderr, "Per-core mode requires building with -DCROW_ENABLE_REUSE_PORT\n");
+    return 1;
+#else
+    if (workers == 0)
+        workers = 1;
+
+    workerPids.assign(workers, 0);
+    std::signal(SIGINT, stopWorkers);
+    std::signal(SIGTERM, stopWorkers);
+
+    unsigned int running = 0;
+    for (unsigned int i = 0; i != workers; ++i)
+    {
+        if (!stopping && spawnWorker(i, runWorker) > 0)
+            ++running;
+    }
+
+    while (running > 0)
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        unsigned int index = 0;
+        while (index != workers && workerPids[index] != pid)
+            ++index;
+        if (index == workers)
+            continue;
+
+        workerPids[index] = 0; // pid завершенного процесса может достаться другому, сигнал ему не пересылаем
+
+        // Упавший процесс перезапускается на том же ядре, если сервер не останавливается
+        if (!stopping)
+            sleep(WORKER_RESTART_DELAY);
+
+        if (stopping || spawnWorker(index, runWorker) <= 0)
+        {
+            workerPids[index] = 0;
+            --running;
+        }
+    }
+
+    return 0;
+#endif
+}
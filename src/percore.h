@@ -0,0 +1,20 @@
+﻿#ifndef PERCORE_H
+#define PERCORE_H
+
+#include <csignal>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+const int WORKER_RESTART_DELAY = 1; // Пауза перед перезапуском упавшего процесса (сек)
+
+int runPerCore(unsigned int workers, const std::function<void()>& runWorker);
+
+#endif
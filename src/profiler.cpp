@@ -0,0 +1,228 @@
+﻿#include "profiler.h"
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <map>
+#include <memory>
+#include <sys/time.h>
+#include <thread>
+#include <unordered_map>
+
+namespace profiler
+{
+    std::atomic<Mode> mode{ Mode::Off };
+
+    namespace
+    {
+        struct Sample
+        {
+            std::atomic<bool> ready{ false };
+            int depth = 0;
+            double bytes = 0;
+            double count = 0;
+            void* frames[PROFILE_MAX_DEPTH];
+        };
+
+        // Буфер выделяется до включения сбора и освобождается после того, как последний
+        // обработчик из него вышел, поэтому в обработчике сигнала и в operator new нет выделений
+        Sample* samples = nullptr;
+        std::atomic<size_t> claimed{ 0 };
+        std::atomic<int> inFlight{ 0 };
+        std::atomic<unsigned long long> droppedSamples{ 0 };
+        std::atomic<bool> running{ false };
+        bool handlerInstalled = false; // Под running, поэтому без атомарности
+
+        // Запись стека текущего потока. skip - кадры самого профилировщика, сама запись встраивается
+        // в вызывающую функцию, чтобы их число не зависело от оптимизаций
+        inline __attribute__((always_inline)) void record(int skip, double bytes, double count)
+        {
+            size_t index = claimed.fetch_add(1);
+            if (index >= PROFILE_MAX_SAMPLES)
+            {
+                droppedSamples.fetch_add(1);
+                return;
+            }
+
+            void* frames[PROFILE_MAX_DEPTH + 4];
+            int depth = backtrace(frames, PROFILE_MAX_DEPTH + 4) - skip;
+            depth = std::max(0, std::min(depth, PROFILE_MAX_DEPTH));
+
+            Sample& sample = samples[index];
+            std::memcpy(sample.frames, frames + skip, depth * sizeof(void*));
+            sample.depth = depth;
+            sample.bytes = bytes;
+            sample.count = count;
+            sample.ready.store(true, std::memory_order_release);
+        }
+
+        void onProfile(int)
+        {
+            int savedErrno = errno;
+            inFlight.fetch_add(1);
+            if (mode.load() == Mode::Cpu)
+                record(2, 0, 1); // Обработчик и трамплин возврата из сигнала
+            inFlight.fetch_sub(1);
+            errno = savedErrno;
+        }
+
+        // Имя функции по адресу. Адрес возврата указывает на следующую инструкцию, поэтому ищется
+        // символ байтом раньше. Без имени - модуль и смещение, чтобы кадры не склеивались
+        std::string symbolize(void* address)
+        {
+            Dl_info info;
+            void* lookup = static_cast<char*>(address) - 1;
+            if (!dladdr(lookup, &info))
+                return "[unknown]";
+
+            if (info.dli_sname)
+            {
+                int status = 0;
+                char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+                std::free(demangled);
+                return name;
+            }
+
+            const char* module = info.dli_fname ? std::strrchr(info.dli_fname, '/') : nullptr;
+            char offset[32];
+            std::snprintf(offset, sizeof(offset), "+0x%zx",
+                static_cast<size_t>(static_cast<char*>(lookup) - static_cast<char*>(info.dli_fbase)));
+            return std::string(module ? module + 1 : info.dli_fname ? info.dli_fname : "[unknown]") + offset;
+        }
+
+        // Экспоненциальный интервал между выборками выделений: выборка не совпадает по фазе с
+        // повторяющимся шаблоном выделений. Генератор свой, std::random в operator new не годится
+        thread_local long long untilSample = 0;
+        thread_local uint64_t rngState = 0;
+        thread_local bool inSample = false;
+
+        long long nextInterval()
+        {
+            if (rngState == 0)
+                rngState = reinterpret_cast<uintptr_t>(&rngState) | 1;
+            rngState ^= rngState << 13;
+            rngState ^= rngState >> 7;
+            rngState ^= rngState << 17;
+            double uniform = (rngState >> 11) * (1.0 / 9007199254740992.0);
+            return static_cast<long long>(-std::log(1.0 - uniform) * PROFILE_ALLOC_SAMPLE_BYTES) + 1;
+        }
+    }
+
+    bool start(Mode newMode)
+    {
+        bool expected = false;
+        if (newMode == Mode::Off || !running.compare_exchange_strong(expected, true))
+            return false;
+
+        // Первый вызов backtrace загружает libgcc_s, в обработчике сигнала этого делать нельзя
+        void* warmUp[1];
+        backtrace(warmUp, 1);
+
+        samples = new Sample[PROFILE_MAX_SAMPLES];
+        claimed.store(0);
+        droppedSamples.store(0);
+
+        if (newMode == Mode::Cpu)
+        {
+            // Обработчик ставится один раз и больше не снимается: сигнал таймера может прийти уже
+            // после остановки, а действие по умолчанию для SIGPROF завершает процесс
+            if (!handlerInstalled)
+            {
+                struct sigaction action {};
+                action.sa_handler = onProfile;
+                action.sa_flags = SA_RESTART;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGPROF, &action, nullptr);
+                handlerInstalled = true;
+            }
+
+            mode.store(newMode);
+            itimerval timer{};
+            timer.it_interval.tv_usec = 1000000 / PROFILE_CPU_HZ;
+            timer.it_value = timer.it_interval;
+            setitimer(ITIMER_PROF, &timer, nullptr);
+        }
+        else
+            mode.store(newMode);
+
+        return true;
+    }
+
+    Result stop(Weight weight)
+    {
+        Mode stopped = mode.exchange(Mode::Off);
+        if (stopped == Mode::Cpu)
+        {
+            itimerval timer{};
+            setitimer(ITIMER_PROF, &timer, nullptr); // Опоздавший сигнал обработчик пропустит по mode
+        }
+
+        // Дожидаемся потоков, которые уже начали запись выборки
+        while (inFlight.load() != 0)
+            std::this_thread::yield();
+
+        Result result;
+        std::unordered_map<void*, std::string> names;
+        std::map<std::string, double> stacks;
+        size_t count = std::min(claimed.load(), PROFILE_MAX_SAMPLES);
+        for (size_t i = 0; i != count; ++i)
+        {
+            const Sample& sample = samples[i];
+            if (!sample.ready.load(std::memory_order_acquire) || sample.depth == 0)
+                continue;
+
+            std::string stack;
+            for (int j = sample.depth - 1; j >= 0; --j)
+            {
+                auto it = names.find(sample.frames[j]);
+                if (it == names.end())
+                    it = names.emplace(sample.frames[j], symbolize(sample.frames[j])).first;
+                stack += it->second;
+                if (j != 0)
+                    stack += ';';
+            }
+
+            stacks[stack] += weight == Weight::Bytes ? sample.bytes : weight == Weight::Count ? sample.count : 1;
+            ++result.samples;
+        }
+
+        for (const auto& [stack, value] : stacks)
+            result.folded += stack + ' ' + std::to_string(std::llround(value)) + '\n';
+        result.dropped = droppedSamples.load();
+
+        delete[] samples;
+        samples = nullptr;
+        running.store(false);
+        return result;
+    }
+
+    // Выделение размера size попадает в выборку с вероятностью p = 1 - exp(-size / T), поэтому
+    // выборка представляет size / p байт и 1 / p выделений, и оценки по выборкам несмещенные
+    __attribute__((noinline)) void sampleAllocation(size_t size)
+    {
+        if (mode.load(std::memory_order_relaxed) != Mode::Alloc || inSample)
+            return;
+
+        if (untilSample == 0)
+            untilSample = nextInterval();
+        untilSample -= static_cast<long long>(size);
+        if (untilSample > 0)
+            return;
+        untilSample = nextInterval();
+
+        inSample = true; // backtrace при первом вызове сам может выделять память
+        inFlight.fetch_add(1);
+        if (mode.load() == Mode::Alloc)
+        {
+            double probability = -std::expm1(-static_cast<double>(size) / PROFILE_ALLOC_SAMPLE_BYTES);
+            record(2, size / probability, 1 / probability); // sampleAllocation и operator new
+        }
+        inFlight.fetch_sub(1);
+        inSample = false;
+    }
+}
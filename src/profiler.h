@@ -0,0 +1,53 @@
+﻿#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+const int PROFILE_MAX_SECONDS = 60; // Наибольшая длительность одного профилирования
+const int PROFILE_CPU_HZ = 99; // Выборок в секунду процессорного времени, не кратно таймерам ядра
+const size_t PROFILE_ALLOC_SAMPLE_BYTES = 256 * 1024; // Средний объем выделений между выборками
+const size_t PROFILE_MAX_SAMPLES = 20000; // Выборки сверх этого числа отбрасываются
+const int PROFILE_MAX_DEPTH = 48; // Кадров стека в выборке
+
+// Профилировщик работающего процесса без перезапуска под perf. В режиме Cpu таймер ITIMER_PROF
+// присылает SIGPROF потоку, который занимает процессор, и обработчик записывает его стек. В режиме
+// Alloc замещенный operator new (alloc_stats.cpp) записывает стек в среднем раз в
+// PROFILE_ALLOC_SAMPLE_BYTES байт, вес выборки - оценка числа выделений и байт, которые она
+// представляет. Для имен функций сервер собирается с -rdynamic
+namespace profiler
+{
+    enum class Mode
+    {
+        Off,
+        Cpu,
+        Alloc
+    };
+
+    enum class Weight
+    {
+        Samples, // Cpu: число выборок
+        Bytes, // Alloc: выделенные байты
+        Count // Alloc: число выделений
+    };
+
+    // Начало сбора выборок, false - профилирование уже идет
+    bool start(Mode mode);
+
+    // Остановка и свертка стеков в формате flamegraph.pl: строка "корень;...;лист вес"
+    struct Result
+    {
+        std::string folded;
+        size_t samples = 0;
+        unsigned long long dropped = 0;
+    };
+    Result stop(Weight weight);
+
+    extern std::atomic<Mode> mode;
+
+    // Вызывается из operator new. Пока профилирование выделений выключено, стоит одного чтения
+    void sampleAllocation(size_t size);
+}
+
+#endif
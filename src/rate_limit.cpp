@@ -0,0 +1,234 @@
+﻿#include "rate_limit.h"
+#include "cache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace ratelimit
+{
+    // Корзина в Redis пополняется по времени сервера Redis, поэтому часы экземпляров не обязаны
+    // совпадать. Возвращается остаток токенов после вычета израсходованного, он может быть отрицательным
+    static const char* RECONCILE_SCRIPT =
+        "local rate = tonumber(ARGV[2]) local burst = tonumber(ARGV[3]) "
+        "local t = redis.call('TIME') local now = tonumber(t[1]) + tonumber(t[2]) / 1000000 "
+        "local state = redis.call('HMGET', KEYS[1], 'tokens', 'ts') "
+        "local tokens = tonumber(state[1]) or burst "
+        "local ts = tonumber(state[2]) or now "
+        "tokens = math.min(burst, tokens + (now - ts) * rate) - tonumber(ARGV[1]) "
+        "redis.call('HSET', KEYS[1], 'tokens', tokens, 'ts', now) "
+        "redis.call('EXPIRE', KEYS[1], math.ceil(burst / rate) + 60) "
+        "return tostring(tokens)";
+
+    Limiter::Limiter()
+    {
+        std::thread([this] { run(); }).detach();
+    }
+
+    Limiter& Limiter::getInstance()
+    {
+        static Limiter limiter;
+        return limiter;
+    }
+
+    Limiter::Shard& Limiter::shard(const std::string& key)
+    {
+        return shards[std::hash<std::string>()(key) % RATE_LIMIT_SHARDS];
+    }
+
+    int Limiter::tryConsume(const std::string& key, const Limit& limit)
+    {
+        if (limit.perSecond <= 0)
+            return 0;
+
+        auto now = Clock::now();
+        Shard& part = shard(key);
+        std::lock_guard<std::mutex> lock(part.mtx);
+
+        Bucket& bucket = part.buckets.try_emplace(key, Bucket{ limit, limit.burst, 0, now, now }).first->second;
+        double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+        bucket.tokens = std::min(limit.burst, bucket.tokens + elapsed * limit.perSecond);
+        bucket.refilled = now;
+        bucket.used = now;
+
+        if (bucket.tokens < 1)
+        {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return std::max(1, static_cast<int>(std::ceil((1 - bucket.tokens) / limit.perSecond)));
+        }
+
+        bucket.tokens -= 1;
+        bucket.pending += 1;
+        return 0;
+    }
+
+    // Сбор израсходованного по всем корзинам. Давно не использованные корзины удаляются, если им
+    // нечего отправлять
+    std::vector<Limiter::Usage> Limiter::collect()
+    {
+        std::vector<Usage> result;
+        auto idleBefore = Clock::now() - std::chrono::seconds(RATE_LIMIT_IDLE_SECONDS);
+        for (auto& part : shards)
+        {
+            std::lock_guard<std::mutex> lock(part.mtx);
+            for (auto it = part.buckets.begin(); it != part.buckets.end();)
+            {
+                Bucket& bucket = it->second;
+                if (bucket.pending > 0)
+                {
+                    result.push_back({ it->first, bucket.limit, bucket.pending });
+                    bucket.pending = 0;
+                }
+                else if (bucket.used < idleBefore)
+                {
+                    it = part.buckets.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+        }
+        return result;
+    }
+
+    // Общий остаток не учитывает запросы, пришедшие за время сверки, они вычитаются из него
+    void Limiter::apply(const Usage& usage, double remaining)
+    {
+        Shard& part = shard(usage.key);
+        std::lock_guard<std::mutex> lock(part.mtx);
+        auto it = part.buckets.find(usage.key);
+        if (it == part.buckets.end())
+            return;
+
+        Bucket& bucket = it->second;
+        bucket.tokens = std::min(usage.limit.burst, remaining - bucket.pending);
+        bucket.refilled = Clock::now();
+    }
+
+    // Сверка не удалась: израсходованное отправится со следующей сверкой
+    void Limiter::restore(const Usage& usage)
+    {
+        Shard& part = shard(usage.key);
+        std::lock_guard<std::mutex> lock(part.mtx);
+        auto it = part.buckets.find(usage.key);
+        if (it != part.buckets.end())
+            it->second.pending += usage.consumed;
+    }
+
+    // Команды корзин отправляются в Redis пакетами по RATE_LIMIT_SYNC_BATCH, ответы пакета читаются
+    // после отправки всего пакета, так что сверка стоит один обмен с Redis на пакет
+    void Limiter::run()
+    {
+        while (true)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(RATE_LIMIT_SYNC_INTERVAL_MS));
+
+            std::vector<Usage> usages = collect();
+            bool synced = true;
+            for (size_t begin = 0; begin < usages.size(); begin += RATE_LIMIT_SYNC_BATCH)
+            {
+                size_t end = std::min(usages.size(), begin + RATE_LIMIT_SYNC_BATCH);
+                synced = sync(usages.data() + begin, usages.data() + end) && synced;
+            }
+
+            if (usages.empty())
+                continue;
+            if (synced)
+                syncs.fetch_add(1, std::memory_order_relaxed);
+            else
+                syncFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Сверка пакета корзин. Корзина, для которой ответа нет, остается локальной до следующей сверки.
+    // Скрипт загружается в Redis один раз (SCRIPT LOAD), дальше корзины сверяются через EVALSHA без
+    // передачи текста скрипта. Если Redis скрипт забыл (перезапуск, SCRIPT FLUSH), эти корзины
+    // сверяются повторно через EVAL, а скрипт загружается заново при следующей сверке
+    bool Limiter::sync(const Usage* begin, const Usage* end)
+    {
+        auto redis = connectRedis();
+        if (!redis)
+        {
+            for (const Usage* usage = begin; usage != end; ++usage)
+                restore(*usage);
+            return false;
+        }
+
+        if (scriptSha.empty())
+        {
+            redisReply* reply = static_cast<redisReply*>(redisCommand(redis, "SCRIPT LOAD %s", RECONCILE_SCRIPT));
+            if (reply && reply->type == REDIS_REPLY_STRING)
+                scriptSha.assign(reply->str, reply->len);
+            if (reply)
+                freeReplyObject(reply);
+        }
+
+        auto append = [&](const Usage& usage, bool withScript)
+        {
+            std::string key = "ratelimit:" + usage.key;
+            std::string consumed = std::to_string(usage.consumed);
+            std::string rate = std::to_string(usage.limit.perSecond);
+            std::string burst = std::to_string(usage.limit.burst);
+            if (withScript || scriptSha.empty())
+                redisAppendCommand(redis, "EVAL %s 1 %s %s %s %s", RECONCILE_SCRIPT, key.c_str(),
+                    consumed.c_str(), rate.c_str(), burst.c_str());
+            else
+                redisAppendCommand(redis, "EVALSHA %s 1 %s %s %s %s", scriptSha.c_str(), key.c_str(),
+                    consumed.c_str(), rate.c_str(), burst.c_str());
+        };
+
+        // Ответы дочитываются до конца, чтобы соединение вернулось в пул без чужих ответов. После
+        // ошибки соединения контекст hiredis больше не читает, и оставшиеся корзины восстанавливаются
+        bool synced = true;
+        std::vector<const Usage*> noScript;
+        auto read = [&](const Usage& usage)
+        {
+            redisReply* reply = nullptr;
+            if (redisGetReply(redis, reinterpret_cast<void**>(&reply)) != REDIS_OK || !reply)
+            {
+                restore(usage);
+                synced = false;
+                return;
+            }
+            if (reply->type == REDIS_REPLY_STRING)
+                apply(usage, std::strtod(reply->str, nullptr));
+            else if (reply->type == REDIS_REPLY_ERROR && std::strncmp(reply->str, "NOSCRIPT", 8) == 0)
+                noScript.push_back(&usage);
+            else
+            {
+                restore(usage);
+                synced = false;
+            }
+            freeReplyObject(reply);
+        };
+
+        for (const Usage* usage = begin; usage != end; ++usage)
+            append(*usage, false);
+        for (const Usage* usage = begin; usage != end; ++usage)
+            read(*usage);
+
+        if (!noScript.empty())
+        {
+            scriptSha.clear();
+            std::vector<const Usage*> retry;
+            retry.swap(noScript);
+            for (const Usage* usage : retry)
+                append(*usage, true);
+            for (const Usage* usage : retry)
+                read(*usage);
+        }
+        return synced;
+    }
+
+    Limiter::Stats Limiter::stats()
+    {
+        Stats result{ 0, rejected.load(std::memory_order_relaxed), syncs.load(std::memory_order_relaxed),
+            syncFailures.load(std::memory_order_relaxed) };
+        for (auto& part : shards)
+        {
+            std::lock_guard<std::mutex> lock(part.mtx);
+            result.buckets += part.buckets.size();
+        }
+        return result;
+    }
+}
@@ -0,0 +1,97 @@
+﻿#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const double RATE_LIMIT_AUTH_PER_SECOND = 0.5; // Входов и регистраций с одного IP в секунду, 0 - без ограничения
+const double RATE_LIMIT_AUTH_BURST = 10;
+const double RATE_LIMIT_WRITE_PER_SECOND = 20; // Изменяющих запросов одного пользователя (без токена - одного IP) в секунду
+const double RATE_LIMIT_WRITE_BURST = 100;
+const int RATE_LIMIT_SYNC_INTERVAL_MS = 1000; // Как часто локальные корзины сверяются с Redis
+const size_t RATE_LIMIT_SYNC_BATCH = 500; // Корзин в одном пакете команд к Redis
+const int RATE_LIMIT_IDLE_SECONDS = 300; // Корзина без запросов дольше этого удаляется
+const int RATE_LIMIT_SHARDS = 64;
+
+// Ограничение частоты запросов корзиной токенов. Токены расходуются локально, без обращения к Redis,
+// а фоновый поток раз в RATE_LIMIT_SYNC_INTERVAL_MS отправляет в Redis, сколько токенов израсходовано
+// с прошлой сверки, и получает общий остаток корзины по всем экземплярам сервера. Между сверками каждый
+// экземпляр пополняет корзину сам, поэтому ограничение общее приближенно: превышение не больше
+// пополнения за один интервал на каждом экземпляре. Если Redis недоступен, ограничение остается локальным
+namespace ratelimit
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Limit
+    {
+        double perSecond;
+        double burst;
+    };
+
+    const Limit AUTH_LIMIT{ RATE_LIMIT_AUTH_PER_SECOND, RATE_LIMIT_AUTH_BURST };
+    const Limit WRITE_LIMIT{ RATE_LIMIT_WRITE_PER_SECOND, RATE_LIMIT_WRITE_BURST };
+
+    class Limiter
+    {
+    public:
+        static Limiter& getInstance();
+
+        // 0, если запрос разрешен, иначе через сколько секунд повторить
+        int tryConsume(const std::string& key, const Limit& limit);
+
+        struct Stats
+        {
+            size_t buckets;
+            long long rejected;
+            long long syncs;
+            long long syncFailures;
+        };
+
+        Stats stats();
+
+    private:
+        Limiter();
+
+        struct Bucket
+        {
+            Limit limit;
+            double tokens;
+            double pending; // Израсходовано с прошлой сверки
+            Clock::time_point refilled;
+            Clock::time_point used;
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mtx;
+            std::unordered_map<std::string, Bucket> buckets;
+        };
+
+        // Израсходованное корзиной, которое уходит на сверку
+        struct Usage
+        {
+            std::string key;
+            Limit limit;
+            double consumed;
+        };
+
+        Shard shards[RATE_LIMIT_SHARDS];
+        std::atomic<long long> rejected{ 0 };
+        std::atomic<long long> syncs{ 0 };
+        std::atomic<long long> syncFailures{ 0 };
+        std::string scriptSha; // sha1 скрипта сверки, загруженного в Redis. Используется только потоком сверки
+
+        Shard& shard(const std::string& key);
+        std::vector<Usage> collect();
+        void apply(const Usage& usage, double remaining);
+        void restore(const Usage& usage);
+        bool sync(const Usage* begin, const Usage* end);
+        void run();
+    };
+}
+
+#endif
@@ -0,0 +1,74 @@
+﻿#ifndef REQUEST_EXECUTOR_H
+#define REQUEST_EXECUTOR_H
+
+#include <memory>
+#include "async_pool.h"
+#include "alloc_stats.h"
+#include "deadline.h"
+#include "fairness.h"
+
+// Исполнитель корутины запроса: на время выполнения каждой своей функции выставляет счетчики выделений
+// (allocstats::current), срок (deadline::current) и пользователя (fairness::currentUser) запроса.
+// Состоянием владеют и запрос, и копии исполнителя: копия может пережить запрос, например в сокете
+// соединения из пула
+template <typename Inner>
+class RequestExecutor
+{
+public:
+    RequestExecutor(Inner inner, std::shared_ptr<allocstats::Counters> counters, std::shared_ptr<deadline::Deadline> requestDeadline, int user_id)
+        : inner(std::move(inner)), counters(std::move(counters)), requestDeadline(std::move(requestDeadline)), user_id(user_id) {}
+
+    template <typename Property>
+    auto query(const Property& property) const -> decltype(asio::query(std::declval<const Inner&>(), property))
+    {
+        return asio::query(inner, property);
+    }
+
+    template <typename Property>
+    auto require(const Property& property) const
+        -> RequestExecutor<std::decay_t<decltype(asio::require(std::declval<const Inner&>(), property))>>
+    {
+        return { asio::require(inner, property), counters, requestDeadline, user_id };
+    }
+
+    template <typename Property>
+    auto prefer(const Property& property) const
+        -> RequestExecutor<std::decay_t<decltype(asio::prefer(std::declval<const Inner&>(), property))>>
+    {
+        return { asio::prefer(inner, property), counters, requestDeadline, user_id };
+    }
+
+    template <typename Function>
+    void execute(Function function) const
+    {
+        inner.execute([counters = counters, requestDeadline = requestDeadline, user_id = user_id, function = std::move(function)]() mutable
+        {
+            allocstats::Counters* previousCounters = allocstats::current;
+            deadline::Deadline* previousDeadline = deadline::current;
+            int previousUser = fairness::currentUser;
+            allocstats::current = counters.get();
+            deadline::current = requestDeadline.get();
+            fairness::currentUser = user_id;
+            function();
+            allocstats::current = previousCounters;
+            deadline::current = previousDeadline;
+            fairness::currentUser = previousUser;
+        });
+    }
+
+    bool operator==(const RequestExecutor& other) const noexcept
+    {
+        return inner == other.inner && counters == other.counters && requestDeadline == other.requestDeadline && user_id == other.user_id;
+    }
+    bool operator!=(const RequestExecutor& other) const noexcept { return !(*this == other); }
+
+private:
+    template <typename> friend class RequestExecutor;
+
+    Inner inner;
+    std::shared_ptr<allocstats::Counters> counters;
+    std::shared_ptr<deadline::Deadline> requestDeadline;
+    int user_id;
+};
+
+#endif
@@ -4,12 +4,59 @@
 #include "database.h"
 #include "cache.h"
 #include "comment.h"
-int main() 
+#include "bloom.h"
+#include "dictionary.h"
+#include "percore.h"
+#include "access_log.h"
+#include "debug.h"
+#include "request_executor.h"
+
+// Запуск обработчика-корутины в потоке, который обслуживает соединение. Обработчик Crow сразу
+// возвращает управление, а ответ отправляется, когда корутина завершится
+void runAsync(const crow::request& req, crow::response& res, asio::awaitable<crow::response> handler)
+{
+    // Корутина продолжается на исполнителе, который на время каждого ее шага выставляет счетчики
+    // выделений, срок и пользователя запроса. Синхронная часть запроса на этом заканчивается
+    RequestExecutor executor(req.io_service->get_executor(), accesslog::allocationCounters(req),
+        accesslog::requestDeadline(req), accesslog::user(req));
+    allocstats::current = nullptr;
+    deadline::current = nullptr;
+    fairness::currentUser = 0;
+
+    asio::co_spawn(executor, std::move(handler),
+        [&res](std::exception_ptr error, crow::response response)
+        {
+            if (error)
+                response = crow::response(500, "Internal server error");
+
+            // Заголовки, которые Crow уже выставил для соединения, сохраняются
+            res.code = response.code;
+            res.body = std::move(response.body);
+            for (const auto& [name, value] : response.headers)
+                res.set_header(name, value);
+            res.end();
+        });
+}
+
+// Запуск сервера. В режиме по ядру процесс обслуживает одно ядро: один поток принимает соединения,
+// один обрабатывает запросы, пулы соединений меньше, так как у каждого процесса они свои
+void runServer(bool perCore)
 {
+    if (perCore)
+    {
+        ConnectionPool::setSize(MIN_SIZE_POOL_PER_CORE, MAX_SIZE_POOL_PER_CORE);
+        RedisConnectionPool::setSize(MIN_SIZE_R_PER_CORE, MAX_SIZE_R_PER_CORE);
+    }
+
     ConnectionPool::getInstance(); // Создание пула соединений к БД
     RedisConnectionPool::getInstance(); // Создание пула соединений к Redis
+    TaskIdFilter::getInstance(); // Загрузка фильтра существующих задач
+    Dictionaries::getInstance(); // Загрузка справочников статусов и тегов
     
-    crow::SimpleApp app; 
+    // Журнал запросов пишется промежуточным слоем асинхронно, поэтому построчный журнал Crow
+    // (синхронная запись в stdout из рабочих потоков на каждый запрос) оставлен только для предупреждений
+    App app;
+    app.loglevel(crow::LogLevel::Warning);
 
     // Регистрация
     CROW_ROUTE(app, "/register").methods("POST"_method)([](const crow::request& req) 
@@ -24,65 +71,119 @@ int main()
     });
 
     // Создание новой задачи
-    CROW_ROUTE(app, "/tasks").methods("POST"_method)([](const crow::request& req)
+    CROW_ROUTE(app, "/tasks").methods("POST"_method)([](const crow::request& req, crow::response& res)
     {
-        return task::createTask(req);
+        runAsync(req, res, task::createTask(req));
     });
 
     // Получение задачи по id 
-    CROW_ROUTE(app, "/tasks/<int>").methods("GET"_method)([](const crow::request& req, int task_id)
+    CROW_ROUTE(app, "/tasks/<int>").methods("GET"_method)([](const crow::request& req, crow::response& res, int task_id)
     {
-            return task::getTask(req, task_id);
+        runAsync(req, res, task::getTask(req, task_id));
     });
 
     // Обновление задачи по id 
-    CROW_ROUTE(app, "/tasks/<int>").methods("PUT"_method)([](const crow::request& req, int task_id)
+    CROW_ROUTE(app, "/tasks/<int>").methods("PUT"_method)([](const crow::request& req, crow::response& res, int task_id)
     {
-        return task::updateTask(req, task_id);
+        runAsync(req, res, task::updateTask(req, task_id));
+    });
+
+    // Частичное обновление задачи по id
+    CROW_ROUTE(app, "/tasks/<int>").methods("PATCH"_method)([](const crow::request& req, crow::response& res, int task_id)
+    {
+        runAsync(req, res, task::patchTask(req, task_id));
     });
 
     // Удаление задачи по id
-    CROW_ROUTE(app, "/tasks/<int>").methods("DELETE"_method)([](const crow::request& req, int task_id)
+    CROW_ROUTE(app, "/tasks/<int>").methods("DELETE"_method)([](const crow::request& req, crow::response& res, int task_id)
     {
-            return task::deleteTask(req, task_id);
+        runAsync(req, res, task::deleteTask(req, task_id));
     });
 
     // Получение списка всех задач пользователя
-    CROW_ROUTE(app, "/tasks").methods("GET"_method)([](const crow::request& req)
+    CROW_ROUTE(app, "/tasks").methods("GET"_method)([](const crow::request& req, crow::response& res)
     {
-            return task::getAllTasks(req);
+        runAsync(req, res, task::getAllTasks(req));
     });
 
     // Добавление тегов к задаче
-    CROW_ROUTE(app, "/tasks/<int>/tags").methods("POST"_method)([](const crow::request& req, int task_id)
+    CROW_ROUTE(app, "/tasks/<int>/tags").methods("POST"_method)([](const crow::request& req, crow::response& res, int task_id)
     {
-        return tag::addTags(req, task_id);
+        runAsync(req, res, tag::addTags(req, task_id));
     });
 
     // Добавление комментария к задаче
-    CROW_ROUTE(app, "/tasks/<int>/comments").methods("POST"_method)([](const crow::request& req, int task_id) 
+    CROW_ROUTE(app, "/tasks/<int>/comments").methods("POST"_method)([](const crow::request& req, crow::response& res, int task_id) 
     {
-        return comment::addComment(req, task_id);
+        runAsync(req, res, comment::addComment(req, task_id));
     });
 
     // Получение всех комментариев к задаче
-    CROW_ROUTE(app, "/tasks/<int>/comments").methods("GET"_method)([](const crow::request& req, int task_id) 
+    CROW_ROUTE(app, "/tasks/<int>/comments").methods("GET"_method)([](const crow::request& req, crow::response& res, int task_id) 
     {
-        return comment::getComments(req, task_id);
+        runAsync(req, res, comment::getComments(req, task_id));
     });
 
     // Обновление комментария по id
-    CROW_ROUTE(app, "/tasks/<int>/comments/<int>").methods("PUT"_method)([](const crow::request& req, int task_id, int comment_id) 
+    CROW_ROUTE(app, "/tasks/<int>/comments/<int>").methods("PUT"_method)([](const crow::request& req, crow::response& res, int task_id, int comment_id) 
     {
-        return comment::updateComment(req, task_id, comment_id);
+        runAsync(req, res, comment::updateComment(req, task_id, comment_id));
     });
 
     // Удаление комментария по id
-    CROW_ROUTE(app, "/tasks/<int>/comments/<int>").methods("DELETE"_method)([](const crow::request& req, int task_id, int comment_id) 
+    CROW_ROUTE(app, "/tasks/<int>/comments/<int>").methods("DELETE"_method)([](const crow::request& req, crow::response& res, int task_id, int comment_id) 
+    {
+        runAsync(req, res, comment::deleteComment(req, task_id, comment_id));
+    });
+
+    // Профилирование работающего сервера
+    CROW_ROUTE(app, "/debug/profile").methods("GET"_method)([](const crow::request& req, crow::response& res)
     {
-        return comment::deleteComment(req, task_id, comment_id);
+        runAsync(req, res, debug::profile(req));
     });
 
-    app.port(8080).multithreaded().run();
+    // Выделения памяти по маршрутам
+    CROW_ROUTE(app, "/debug/allocations").methods("GET"_method)([](const crow::request& req)
+    {
+        return debug::allocations(req);
+    });
+
+    // Сброс сводки выделений
+    CROW_ROUTE(app, "/debug/allocations").methods("DELETE"_method)([](const crow::request& req)
+    {
+        return debug::resetAllocations(req);
+    });
+
+    // Состояние автомата защиты Redis
+    CROW_ROUTE(app, "/debug/redis").methods("GET"_method)([](const crow::request& req)
+    {
+        return debug::redis(req);
+    });
+
+    // Пределы одновременных запросов
+    CROW_ROUTE(app, "/debug/admission").methods("GET"_method)([](const crow::request& req)
+    {
+        return debug::admission(req);
+    });
+
+    app.port(8080);
+    if (perCore)
+        app.concurrency(2);
+    else
+        app.multithreaded();
+    app.run();
+}
+
+// Аргументы: без аргументов - один процесс на все ядра, --per-core [N] - N процессов
+// (по умолчанию по числу ядер), каждый со своим сокетом, циклом событий, пулами и кэшами
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--per-core")
+    {
+        unsigned int workers = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+        return runPerCore(workers, [] { runServer(true); });
+    }
+
+    runServer(false);
     return 0;
 }
@@ -0,0 +1,151 @@
+﻿#include "slow_query.h"
+#include "crow_all.h"
+#include "database.h"
+#include <libpq-fe.h>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+namespace slowquery
+{
+    void report(const std::string& name, std::vector<std::string> statements, std::vector<Params> params,
+        long long rows, Clock::duration elapsed)
+    {
+        // Для pipeline размеры параметров каждого запроса пишутся отдельной группой
+        std::string sizes;
+        for (size_t s = 0; s != params.size(); ++s)
+        {
+            if (params.size() > 1)
+                sizes += (s ? "; #" : "#") + std::to_string(s + 1) + ": ";
+            for (size_t i = 0; i != params[s].size(); ++i)
+            {
+                sizes += (i ? ", $" : "$") + std::to_string(i + 1) + "=";
+                sizes += params[s][i] ? std::to_string(params[s][i]->size()) + " bytes" : std::string("NULL");
+            }
+        }
+
+        CROW_LOG_WARNING << "Slow query " << name << ": "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, "
+            << rows << " rows, " << statements.size() << " statements, params [" << sizes << "]";
+
+        if (SLOW_QUERY_EXPLAIN_LIMIT > 0)
+            Explainer::getInstance().submit(name, std::move(statements), std::move(params));
+    }
+
+    Explainer::Explainer() : droppedPlans(0)
+    {
+        std::thread([this] { run(); }).detach();
+    }
+
+    Explainer& Explainer::getInstance()
+    {
+        static Explainer explainer;
+        return explainer;
+    }
+
+    // Запрос, план которого уже снят SLOW_QUERY_EXPLAIN_LIMIT раз, пропускается. При переполнении
+    // очереди план не снимается, чтобы не задерживать запрос
+    void Explainer::submit(const std::string& name, std::vector<std::string> statements, std::vector<Params> params)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        int& count = captured[name];
+        if (count >= SLOW_QUERY_EXPLAIN_LIMIT)
+            return;
+        if (queue.size() >= SLOW_QUERY_QUEUE_LIMIT)
+        {
+            ++droppedPlans;
+            return;
+        }
+        ++count;
+        queue.push_back({ name, std::move(statements), std::move(params) });
+        ready.notify_one();
+    }
+
+    unsigned long long Explainer::dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return droppedPlans;
+    }
+
+    using ResultPtr = std::unique_ptr<PGresult, decltype(&PQclear)>;
+
+    // Выполнение запроса с параметрами на соединении Explainer. Ошибка сервера становится исключением
+    ResultPtr execParams(PGconn* conn, const std::string& sql, const Params& params)
+    {
+        std::vector<const char*> values;
+        for (const auto& param : params)
+            values.push_back(param ? param->c_str() : nullptr);
+
+        ResultPtr result(PQexecParams(conn, sql.c_str(), values.size(), nullptr, values.data(), nullptr, nullptr, 0), PQclear);
+        ExecStatusType status = PQresultStatus(result.get());
+        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK)
+            throw std::runtime_error(PQerrorMessage(conn));
+        return result;
+    }
+
+    // Планы пишутся в отдельный файл: в условиях плана видны значения параметров, а журнал сервера
+    // их не содержит. Соединение свое, чтобы не занимать пул и не мешать обработке запросов
+    void Explainer::run()
+    {
+        FILE* file = std::fopen(SLOW_QUERY_PLAN_FILE.c_str(), "a");
+        if (!file)
+        {
+            CROW_LOG_ERROR << "Cannot open " << SLOW_QUERY_PLAN_FILE << ", query plans are discarded";
+            return;
+        }
+
+        std::unique_ptr<PGconn, decltype(&PQfinish)> conn(nullptr, PQfinish);
+        while (true)
+        {
+            Pending pending;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                ready.wait(lock, [this] { return !queue.empty(); });
+                pending = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            std::time_t now = std::time(nullptr);
+            char time[32];
+            std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+            std::string plan = std::string("-- ") + time + " " + pending.name + "\n";
+
+            try
+            {
+                if (!conn || PQstatus(conn.get()) != CONNECTION_OK)
+                {
+                    conn.reset(PQconnectdb(CONNECTION_STRING.c_str()));
+                    if (PQstatus(conn.get()) != CONNECTION_OK)
+                        throw std::runtime_error(PQerrorMessage(conn.get()));
+                }
+
+                // Запросы pipeline выполняются в одной транзакции по порядку, как и в обработчике, поэтому
+                // следующий запрос видит изменения предыдущего (например, currval после INSERT)
+                execParams(conn.get(), "BEGIN", {});
+                try
+                {
+                    for (size_t i = 0; i != pending.statements.size(); ++i)
+                    {
+                        const Params& params = i < pending.params.size() ? pending.params[i] : Params();
+                        auto result = execParams(conn.get(), "EXPLAIN (ANALYZE, BUFFERS) " + pending.statements[i], params);
+                        for (int row = 0; row != PQntuples(result.get()); ++row)
+                            plan += PQgetvalue(result.get(), row, 0) + std::string("\n");
+                    }
+                }
+                catch (...)
+                {
+                    execParams(conn.get(), "ROLLBACK", {});
+                    throw;
+                }
+                execParams(conn.get(), "ROLLBACK", {});
+            }
+            catch (const std::exception& e)
+            {
+                plan += std::string("EXPLAIN failed: ") + e.what() + "\n";
+            }
+
+            std::fwrite(plan.data(), 1, plan.size(), file);
+            std::fflush(file);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+﻿#ifndef SLOW_QUERY_H
+#define SLOW_QUERY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const int SLOW_QUERY_THRESHOLD_MS = 200; // Выполнения дольше порога попадают в журнал
+const int SLOW_QUERY_EXPLAIN_LIMIT = 3; // Сколько раз для каждого запроса снимается план, 0 - не снимать
+const std::string SLOW_QUERY_PLAN_FILE = "slow_query_plans.log"; // Планы медленных запросов
+const size_t SLOW_QUERY_QUEUE_LIMIT = 100; // Сколько планов может ждать снятия, лишние отбрасываются
+
+namespace slowquery
+{
+    using Clock = std::chrono::steady_clock;
+    using Params = std::vector<std::optional<std::string>>; // Параметры в текстовом виде, nullopt - NULL
+
+    // Проверка выполняется на каждом запросе, поэтому быстрые запросы не берут блокировок и не копируют параметры
+    inline bool isSlow(Clock::duration elapsed)
+    {
+        return elapsed >= std::chrono::milliseconds(SLOW_QUERY_THRESHOLD_MS);
+    }
+
+    // Запись медленного выполнения. В журнал попадают имя запроса, строки, время и только размеры
+    // параметров, сами значения (пароли, тексты задач) не пишутся. statements - запросы, выполненные
+    // вместе (pipeline), params[i] - параметры $1, $2, ... запроса statements[i]
+    void report(const std::string& name, std::vector<std::string> statements, std::vector<Params> params,
+        long long rows, Clock::duration elapsed);
+
+    // Снятие EXPLAIN (ANALYZE, BUFFERS) на отдельном соединении в фоновом потоке для первых
+    // SLOW_QUERY_EXPLAIN_LIMIT медленных выполнений каждого запроса. ANALYZE выполняет запрос,
+    // поэтому все делается в транзакции, которая откатывается. Параметры передаются серверу
+    // отдельно от текста запроса, как и в обработчике
+    class Explainer
+    {
+    public:
+        static Explainer& getInstance();
+        void submit(const std::string& name, std::vector<std::string> statements, std::vector<Params> params);
+        unsigned long long dropped() const;
+
+    private:
+        Explainer();
+
+        struct Pending
+        {
+            std::string name;
+            std::vector<std::string> statements;
+            std::vector<Params> params;
+        };
+
+        mutable std::mutex mtx;
+        std::condition_variable ready;
+        std::deque<Pending> queue;
+        std::unordered_map<std::string, int> captured; // Сколько планов снято для каждого запроса
+        unsigned long long droppedPlans;
+
+        void run();
+    };
+}
+
+#endif
@@ -2,105 +2,203 @@
 
 namespace tag 
 {
-    std::vector<std::string> addTagsToTask(pqxx::work& txn, int task_id, const crow::json::rvalue& jsonData) 
+    // Запросы привязки тегов из запроса к только что созданной задаче. Они отправляются в одном pipeline
+    // с INSERT задачи, поэтому id задачи берется из currval последовательности в той же сессии.
+    // id известных тегов берутся из справочника. Первый запрос создает неизвестные теги и возвращает
+    // созданные, чтобы добавить их в справочник. Второй со своим снимком находит и теги, которые
+    // одновременно создал другой запрос, привязывает все теги и возвращает их названия в порядке id.
+    // Если тегов нет, запросов нет
+    std::vector<Statement> addTagsToNewTaskQueries(const crow::json::rvalue& jsonData)
     {
         std::vector<std::string> tags;
+        std::vector<int> knownIds;
+        std::vector<std::string> unknownNames;
+        std::unordered_set<std::string> seen;
 
-        if (jsonData.has("tags")) {
-            for (const auto& tag : jsonData["tags"]) {
-                std::string tag_name = tag.s();
-                tags.push_back(tag_name); // Добавляем тег в список для возвращения
-
-                // Проверяем, существует ли тег, если нет, то добавляем его
-                auto tagCheck = txn.exec_params("SELECT tag_id FROM tags WHERE tag_name = $1", tag_name);
-                int tag_id;
-
-                if (tagCheck.empty()) 
-                {
-                    // Если тег не существует, создаем новый
-                    auto insertTag = txn.exec_params(
-                        "INSERT INTO tags (tag_name) VALUES ($1) RETURNING tag_id", tag_name
-                    );
-                    tag_id = insertTag[0][0].as<int>();
-                }
-                else 
-                {
-                    tag_id = tagCheck[0][0].as<int>();
-                }
-
-                // Привязываем тег к задаче
-                txn.exec_params("INSERT INTO task_tags (task_id, tag_id) VALUES ($1, $2) ON CONFLICT DO NOTHING", task_id, tag_id);
-            }
+        auto& dictionary = Dictionaries::getInstance();
+        for (const auto& tag_name : tagsFromJson(jsonData))
+        {
+            if (!seen.insert(tag_name).second)
+                continue;
+
+            tags.push_back(tag_name);
+
+            int tag_id = dictionary.tagId(tag_name);
+            if (tag_id > 0)
+                knownIds.push_back(tag_id);
+            else
+                unknownNames.push_back(tag_name);
         }
 
-        return tags; // Возвращаем список тегов для использования в кэше
+        std::vector<Statement> statements;
+        if (tags.empty())
+            return statements;
+
+        statements.push_back(statement(
+            R"(INSERT INTO tags (tag_name) SELECT unnest($1::text[])
+            ON CONFLICT (tag_name) DO NOTHING
+            RETURNING tag_id, tag_name)",
+            unknownNames
+        ));
+        statements.push_back(statement(
+            R"(WITH linked AS (
+            INSERT INTO task_tags (task_id, tag_id)
+            SELECT currval('public.tasks_task_id_seq'), tag_id FROM tags WHERE tag_name = ANY($2::text[])
+            UNION
+            SELECT currval('public.tasks_task_id_seq'), unnest($1::int[])
+            ON CONFLICT DO NOTHING
+            RETURNING tag_id)
+            SELECT t.tag_name FROM linked l
+            JOIN tags t ON t.tag_id = l.tag_id
+            ORDER BY l.tag_id)",
+            knownIds, unknownNames
+        ));
+        return statements;
     }
 
-
-    void addTagsToResponse(std::string& tags, crow::json::wvalue& response)
+    // Запись поля tags по массиву id вида {1,2,3}, названия берутся из снимка справочника
+    void writeTagNames(std::string_view tagIds, Dictionaries::Snapshot& names, JsonWriter& writer)
     {
-        if (tags.empty() || tags == "{}" || tags == "{NULL}")
-        {
-            response["tags"] = crow::json::wvalue::list();
-            return;
-        }
-        if (tags.front() == '{' && tags.back() == '}')
+        writer.key("tags");
+        writer.beginArray();
+        forEachId(tagIds, [&](int tag_id)
         {
-            tags = tags.substr(1, tags.size() - 2);
-        }
+            if (const std::string* name = names.tagName(tag_id))
+                writer.value(*name);
+        });
+        writer.endArray();
+    }
 
-        std::istringstream ss(tags);
-        std::string tag;
+    // Запросы замены набора тегов задачи. Владелец проверяется в самих запросах, чтобы их можно было
+    // отправить в одном pipeline с UPDATE задачи. Первый создает недостающие теги. Второй со своим
+    // снимком видит и теги, которые одновременно создал другой запрос (для первого это конфликт
+    // ON CONFLICT DO NOTHING), удаляет из task_tags только лишние связи и добавляет только новые.
+    // Второй возвращает итоговый список тегов в порядке id, как их отдает GET
+    std::vector<Statement> setTaskTagsQueries(int task_id, int user_id, const std::vector<std::string>& tags)
+    {
+        std::vector<Statement> statements;
+        statements.push_back(statement(
+            R"(INSERT INTO tags (tag_name)
+            SELECT DISTINCT r.tag_name FROM unnest($2::text[]) AS r(tag_name)
+            WHERE EXISTS (SELECT 1 FROM tasks WHERE task_id = $1 AND user_id = $3)
+            AND NOT EXISTS (SELECT 1 FROM tags t WHERE t.tag_name = r.tag_name)
+            ON CONFLICT (tag_name) DO NOTHING)",
+            task_id, tags, user_id
+        ));
+        statements.push_back(statement(
+            R"(WITH owner AS (
+            SELECT 1 FROM tasks WHERE task_id = $1 AND user_id = $3),
+            final_tags AS (
+            SELECT t.tag_id, t.tag_name FROM tags t
+            WHERE t.tag_name = ANY($2::text[]) AND EXISTS (SELECT 1 FROM owner)),
+            removed AS (
+            DELETE FROM task_tags
+            WHERE task_id = $1 AND EXISTS (SELECT 1 FROM owner) AND tag_id NOT IN (SELECT tag_id FROM final_tags)),
+            added AS (
+            INSERT INTO task_tags (task_id, tag_id)
+            SELECT $1, f.tag_id FROM final_tags f
+            WHERE NOT EXISTS (SELECT 1 FROM task_tags tt WHERE tt.task_id = $1 AND tt.tag_id = f.tag_id))
+            SELECT f.tag_name FROM final_tags f
+            ORDER BY f.tag_id)",
+            task_id, tags, user_id
+        ));
+        return statements;
+    }
 
-        int index = 0;
-        response["tags"] = crow::json::wvalue::list();
+    // Итоговый список тегов из результата последнего запроса setTaskTagsQueries или addTagsToNewTaskQueries
+    std::vector<std::string> tagNamesFromResult(const PgResult& result)
+    {
+        std::vector<std::string> tags;
+        tags.reserve(result.size());
+        for (int i = 0; i != result.size(); ++i)
+            tags.push_back(result.text(i, "tag_name"));
 
-        while (std::getline(ss, tag, ','))
+        return tags;
+    }
+
+    // Список тегов из поля "tags" запроса
+    std::vector<std::string> tagsFromJson(const crow::json::rvalue& jsonData)
+    {
+        std::vector<std::string> tags;
+
+        if (jsonData.has("tags"))
         {
-            response["tags"][index++] = tag;
+            for (const auto& tag : jsonData["tags"])
+                tags.push_back(tag.s());
         }
+
+        return tags;
     }
 
-    crow::response addTags(const crow::request& req, int task_id)
+    asio::awaitable<crow::response> addTags(const crow::request& req, int task_id)
     {
         try
         {
             int user_id;
             if (!auth::checkToken(req, user_id))
-                return crow::response(401, "Missing or invalid authorization token");
-
-            auto db = connectDB();
-            if (!db.is_open())
-                return crow::response(500, "Internal server error");
+                co_return crow::response(401, "Missing or invalid authorization token");
 
             auto jsonData = crow::json::load(req.body);
             if (!jsonData || !jsonData.has("tags")) {
-                return crow::response(400, "Invalid or missing JSON");
+                co_return crow::response(400, "Invalid or missing JSON");
             }
 
-            pqxx::work txn(db);
-
-            // Проверка, существует ли задача с task_id и принадлежит ли она пользователю
-            auto taskCheck = txn.exec_params(
-                "SELECT task_id FROM tasks WHERE task_id = $1 AND user_id = $2", task_id, user_id
-            );
-
-            if (taskCheck.empty())
-                return crow::response(403, "Access denied");
-
-            // Добавляем теги к задаче
-            tag::addTagsToTask(txn, task_id, jsonData);
-
-            txn.commit();
+            // Несуществующую задачу отсекаем без обращения к бд
+            if (!TaskIdFilter::getInstance().mayExist(task_id))
+                co_return crow::response(404, "Task not found");
+
+            // Первый запрос создает недостающие теги, если задача принадлежит пользователю. Второй со своим
+            // снимком (он видит и теги, которые одновременно создал другой запрос) проверяет владельца,
+            // увеличивает версии задачи и списка (изменение тегов меняет представление задачи) и добавляет
+            // теги. Если задача чужая, upd пуст и теги не добавляются
+            std::vector<std::string> tags = tag::tagsFromJson(jsonData);
+            std::vector<Statement> statements;
+            statements.push_back(statement(
+                R"(INSERT INTO tags (tag_name)
+                SELECT DISTINCT r.tag_name FROM unnest($1::text[]) AS r(tag_name)
+                WHERE EXISTS (SELECT 1 FROM tasks WHERE task_id = $2 AND user_id = $3)
+                AND NOT EXISTS (SELECT 1 FROM tags t WHERE t.tag_name = r.tag_name)
+                ON CONFLICT (tag_name) DO NOTHING)",
+                tags, task_id, user_id
+            ));
+            statements.push_back(statement(
+                R"(WITH upd AS (
+                UPDATE tasks SET updated_at = NOW() WHERE task_id = $1 AND user_id = $2 RETURNING task_id),
+                ver AS (
+                UPDATE users SET tasks_version = tasks_version + 1
+                WHERE user_id = $2 AND EXISTS (SELECT 1 FROM upd)
+                RETURNING tasks_version),
+                added AS (
+                INSERT INTO task_tags (task_id, tag_id)
+                SELECT upd.task_id, t.tag_id FROM upd CROSS JOIN tags t
+                WHERE t.tag_name = ANY($3::text[])
+                ON CONFLICT DO NOTHING)
+                SELECT ver.tasks_version, EXISTS (SELECT 1 FROM tasks WHERE task_id = $1) AS task_exists
+                FROM (SELECT 1) AS one
+                LEFT JOIN ver ON true)",
+                task_id, user_id, tags
+            ));
+
+            auto results = co_await asyncPipeline("add_task_tags", std::move(statements));
+            const auto& result = results[1];
+
+            if (result.isNull(0, "tasks_version"))
+            {
+                co_await saveMissingTaskInCacheAsync(task_id, user_id);
+                if (result.boolean(0, "task_exists"))
+                    co_return crow::response(403, "Access denied");
+                co_return crow::response(404, "Task not found");
+            }
 
             // Удаляем из кэша, так как данные в кэше стали неактуальными
-            deleteTaskFromCache(task_id, user_id);
+            co_await deleteTaskFromCacheAsync(task_id, user_id);
+            co_await saveTaskListVersionInCacheAsync(user_id, result.integer(0, "tasks_version"));
 
-            return crow::response(200, "Tags were added successfully");
+            co_return crow::response(200, "Tags were added successfully");
         }
         catch (const std::exception& e)
         {
-            return crow::response(400, e.what());
+            co_return crow::response(400, e.what());
         }
     }
 }
\ No newline at end of file
@@ -2,17 +2,23 @@
 #define TAG_H
 
 #include "crow_all.h"
-#include <pqxx/pqxx>
-#include <hiredis/hiredis.h>
 #include "auth.h"
-#include "cache.h"
+#include "bloom.h"
+#include "dictionary.h"
+#include "json_writer.h"
+#include "async_database.h"
+#include "async_cache.h"
+#include <unordered_set>
 
 namespace tag 
 {
-    std::vector<std::string> addTagsToTask(pqxx::work& txn, int task_id, const crow::json::rvalue& jsonData);
-    void addTagsToResponse(std::string& tags, crow::json::wvalue& response);
+    std::vector<Statement> addTagsToNewTaskQueries(const crow::json::rvalue& jsonData);
+    std::vector<Statement> setTaskTagsQueries(int task_id, int user_id, const std::vector<std::string>& tags);
+    std::vector<std::string> tagNamesFromResult(const PgResult& result);
+    std::vector<std::string> tagsFromJson(const crow::json::rvalue& jsonData);
+    void writeTagNames(std::string_view tagIds, Dictionaries::Snapshot& names, JsonWriter& writer);
 
-    crow::response addTags(const crow::request& req, int task_id);
+    asio::awaitable<crow::response> addTags(const crow::request& req, int task_id);
 }
 
 #endif 
\ No newline at end of file
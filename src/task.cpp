@@ -2,22 +2,57 @@
 
 namespace task
 {
-    crow::response createTask(const crow::request& req)
+    // Поля задачи без тегов. Общие для ответа из бд и для записи кэша после изменения задачи
+    void writeTaskFields(JsonWriter& writer, long long task_id, std::string_view task_name, std::string_view description,
+        std::string_view status, long long priority, std::optional<std::string_view> due_date)
+    {
+        writer.key("task_id");
+        writer.value(task_id);
+        writer.key("task_name");
+        writer.value(task_name);
+        writer.key("description");
+        writer.value(description);
+        writer.key("status");
+        writer.value(status);
+        writer.key("priority");
+        writer.value(priority);
+        writer.key("due_date");
+        if (due_date)
+            writer.value(*due_date);
+        else
+            writer.null();
+    }
+
+    // Сохранение в кэш задачи, которую обработчик только что записал в бд. JSON собирается на арене
+    asio::awaitable<void> saveWrittenTask(int task_id, int user_id, const std::string& task_name, const std::string& description,
+        std::string_view status, int priority, const std::string& due_date, const std::vector<std::string>& tags, const std::string& taskEtag)
+    {
+        RequestArena arena;
+        JsonWriter writer(arena.resource());
+        writer.beginObject();
+        writeTaskFields(writer, task_id, task_name, description, status, priority, due_date);
+        writer.key("tags");
+        writer.beginArray();
+        for (const auto& tag_name : tags)
+            writer.value(tag_name);
+        writer.endArray();
+        writer.endObject();
+
+        co_await saveTaskInCacheAsync(task_id, user_id, writer.str(), taskEtag, arena.resource());
+    }
+
+    asio::awaitable<crow::response> createTask(const crow::request& req)
     {
         try
         {
             int user_id;
             // Проверяем токен и получаем user_id
             if (!auth::checkToken(req, user_id)) 
-                return crow::response(401, "Missing or invalid authorization token");
-
-            auto db = connectDB();
-            if (!db.is_open())
-                return crow::response(500, "Internal server error");
+                co_return crow::response(401, "Missing or invalid authorization token");
 
             auto jsonData = crow::json::load(req.body);
             if (!jsonData || !jsonData.has("task_name") || !jsonData.has("description"))
-                return crow::response(400, "Invalid or missing JSON");
+                co_return crow::response(400, "Invalid or missing JSON");
 
             std::string task_name = jsonData["task_name"].s();
             std::string description = jsonData["description"].s();
@@ -25,55 +60,76 @@ namespace task
             int priority = jsonData.has("priority") ? jsonData["priority"].i() : 1; // Значение по умолчанию 1
             std::string due_date = jsonData.has("due_date") ? jsonData["due_date"].s() : std::string("2099-12-31");
 
-            pqxx::work txn(db);
-
-            auto taskInsert = txn.exec_params(
+            // Вместе с задачей увеличиваем версию списка задач пользователя
+            std::vector<Statement> statements;
+            statements.push_back(statement(
                 R"(WITH ins AS (
                 INSERT INTO tasks (user_id, task_name, description, status_id, priority, due_date) 
-                VALUES ($1, $2, $3, $4, $5, $6) RETURNING task_id, status_id)
-                SELECT ins.task_id, s.status_name 
+                VALUES ($1, $2, $3, $4, $5, $6) RETURNING task_id, status_id, due_date, version),
+                ver AS (
+                UPDATE users SET tasks_version = tasks_version + 1 WHERE user_id = $1 RETURNING tasks_version)
+                SELECT ins.task_id, ins.status_id, ins.due_date, ins.version, ver.tasks_version 
                 FROM ins 
-                JOIN task_statuses s ON ins.status_id = s.status_id)",
+                CROSS JOIN ver)",
                 user_id, task_name, description, status_id, priority, due_date
-            );
+            ));
+
+            // Если есть теги, их привязка уходит в том же pipeline, что и INSERT задачи
+            for (auto& tagsStatement : tag::addTagsToNewTaskQueries(jsonData))
+                statements.push_back(std::move(tagsStatement));
 
-            int task_id = taskInsert[0][0].as<int>();
+            auto results = co_await asyncPipeline("create_task", std::move(statements));
+            const auto& taskInsert = results[0];
+            int task_id = static_cast<int>(taskInsert.integer(0, "task_id"));
 
-            // Проверяем наличие тегов и добавляем их, если они есть
-            std::vector<std::string> tags = tag::addTagsToTask(txn, task_id, jsonData);
-            std::string status_name = taskInsert[0]["status_name"].as<std::string>();
+            std::vector<std::string> tags;
+            std::vector<std::pair<int, std::string>> createdTags;
+            if (results.size() > 1)
+            {
+                for (int i = 0; i != results[1].size(); ++i)
+                    createdTags.emplace_back(static_cast<int>(results[1].integer(i, "tag_id")), results[1].text(i, "tag_name"));
+                tags = tag::tagNamesFromResult(results.back());
+            }
 
-            txn.commit();
+            status_id = static_cast<int>(taskInsert.integer(0, "status_id"));
+            due_date = taskInsert.text(0, "due_date"); // Дата в том виде, в котором ее вернет GET
+            std::string taskEtag = etag::forTask(task_id, taskInsert.integer(0, "version"));
+            long long listVersion = taskInsert.integer(0, "tasks_version");
+
+            TaskIdFilter::getInstance().add(task_id);
+            Dictionaries::getInstance().addTags(createdTags);
 
             // Сохраняем в кэш
-            saveTaskInCache(task_id, user_id, task_name, description, status_name, priority, due_date, tags);
+            auto names = co_await Dictionaries::getInstance().snapshotFor(std::vector<int>(1, status_id), std::vector<int>());
+            co_await saveWrittenTask(task_id, user_id, task_name, description, names.statusName(status_id), priority, due_date, tags, taskEtag);
+            co_await saveTaskListVersionInCacheAsync(user_id, listVersion);
 
             crow::json::wvalue response;
             response["message"] = "Task was created successfully";
             response["task_id"] = task_id; // Возвращаем id созданной задачи
-            return crow::response(201, response);
+            co_return crow::response(201, response);
         }
         catch (const std::exception& e)
         {
-            return crow::response(400, e.what());
+            co_return crow::response(400, e.what());
         }
     }
 
-    crow::response updateTask(const crow::request& req, int task_id)
+    asio::awaitable<crow::response> updateTask(const crow::request& req, int task_id)
     {
         try
         {
             int user_id;
             if (!auth::checkToken(req, user_id))
-                return crow::response(401, "Missing or invalid authorization token");
-
-            auto db = connectDB();
-            if (!db.is_open())
-                return crow::response(500, "Internal server error");
+                co_return crow::response(401, "Missing or invalid authorization token");
 
             auto jsonData = crow::json::load(req.body);
             if (!jsonData || !jsonData.has("task_name") || !jsonData.has("description"))
-                return crow::response(400, "Missing or invalid JSON");
+                co_return crow::response(400, "Missing or invalid JSON");
+
+            // Несуществующую задачу отсекаем без обращения к бд
+            if (!TaskIdFilter::getInstance().mayExist(task_id))
+                co_return crow::response(404, "Task not found");
 
             std::string task_name = jsonData["task_name"].s();
             std::string description = jsonData["description"].s();
@@ -81,227 +137,486 @@ namespace task
             int priority = jsonData.has("priority") ? jsonData["priority"].i() : 1;
             std::string due_date = jsonData.has("due_date") ? jsonData["due_date"].s() : std::string("2099-12-31");
 
-            pqxx::work txn(db);
-
-            auto result = txn.exec_params("SELECT task_id FROM tasks WHERE task_id = $1 AND user_id = $2", task_id, user_id);
-
-            if (result.empty())
-                return crow::response(403, "Access denied");
-
-            // Обновление всех полей задачи
-            auto updateResult = txn.exec_params(
-                R"(UPDATE tasks 
+            // Обновление всех полей задачи с проверкой владельца в том же запросе. Версию задачи
+            // увеличивает триггер, версию списка - второй запрос CTE. Замена тегов сама проверяет
+            // владельца и уходит в том же pipeline
+            std::vector<Statement> statements;
+            statements.push_back(statement(
+                R"(WITH upd AS (
+                UPDATE tasks 
                 SET task_name = $1, description = $2, status_id = $3, priority = $4, due_date = $5 
-                WHERE task_id = $6 
-                RETURNING (SELECT status_name FROM task_statuses WHERE status_id = $3) AS status_name)",
-                task_name, description, status_id, priority, due_date, task_id
-            );
-
-            // Удаляем старые теги
-            txn.exec_params("DELETE FROM task_tags WHERE task_id = $1", task_id);
-
-            // Добавляем новые теги 
-            tag::addTagsToTask(txn, task_id, jsonData);
-
-            txn.commit();
+                WHERE task_id = $6 AND user_id = $7
+                RETURNING due_date, version),
+                ver AS (
+                UPDATE users SET tasks_version = tasks_version + 1
+                WHERE user_id = $7 AND EXISTS (SELECT 1 FROM upd)
+                RETURNING tasks_version)
+                SELECT upd.due_date, upd.version, ver.tasks_version,
+                EXISTS (SELECT 1 FROM tasks WHERE task_id = $6) AS task_exists
+                FROM (SELECT 1) AS one
+                LEFT JOIN upd ON true
+                LEFT JOIN ver ON true)",
+                task_name, description, status_id, priority, due_date, task_id, user_id
+            ));
+            for (auto& tagsStatement : tag::setTaskTagsQueries(task_id, user_id, tag::tagsFromJson(jsonData)))
+                statements.push_back(std::move(tagsStatement));
+
+            auto results = co_await asyncPipeline("update_task", std::move(statements));
+            const auto& updateResult = results[0];
+
+            if (updateResult.isNull(0, "version"))
+            {
+                co_await saveMissingTaskInCacheAsync(task_id, user_id);
+                if (updateResult.boolean(0, "task_exists"))
+                    co_return crow::response(403, "Access denied");
+                co_return crow::response(404, "Task not found");
+            }
 
-            std::vector<std::string> tags = tag::addTagsToTask(txn, task_id, jsonData);
-            std::string status_name = updateResult[0]["status_name"].as<std::string>();
+            std::vector<std::string> tags = tag::tagNamesFromResult(results.back());
+            due_date = updateResult.text(0, "due_date");
+            std::string taskEtag = etag::forTask(task_id, updateResult.integer(0, "version"));
 
             // Сохраняем обновленную задачу в кэш
-            saveTaskInCache(task_id, user_id, task_name, description, status_name, priority, due_date, tags); 
+            auto names = co_await Dictionaries::getInstance().snapshotFor(std::vector<int>(1, status_id), std::vector<int>());
+            co_await saveWrittenTask(task_id, user_id, task_name, description, names.statusName(status_id), priority, due_date, tags, taskEtag);
+            co_await saveTaskListVersionInCacheAsync(user_id, updateResult.integer(0, "tasks_version"));
 
-            return crow::response(200, "Task updated successfully");
+            co_return crow::response(200, "Task updated successfully");
         }
         catch (const std::exception& e)
         {
-            return crow::response(400, e.what());
+            co_return crow::response(400, e.what());
         }
     }
 
-    crow::response getTask(const crow::request& req, int task_id)
+    // Столбцы, которые можно изменить через PATCH, в порядке битов маски подготовленного запроса
+    const char* PATCH_COLUMNS[] = { "task_name", "description", "status_id", "priority", "due_date" };
+    const int PATCH_COLUMNS_COUNT = 5;
+
+    // Частичное обновление: меняются только переданные поля, теги - только если они переданы
+    asio::awaitable<crow::response> patchTask(const crow::request& req, int task_id)
     {
         try
         {
             int user_id;
             if (!auth::checkToken(req, user_id))
-                return crow::response(401, "Missing or invalid authorization token");
-
-            auto responseCache = getTaskFromCache(task_id, user_id);
+                co_return crow::response(401, "Missing or invalid authorization token");
 
-            if (!responseCache.count("null")) // Проверяем, нашелся ли ответ в кэше, используя метку "null"
-                return responseCache;
-
-            // Если задачи нет в кэше, идем в бд
-            auto db = connectDB();
-            if (!db.is_open())
+            auto jsonData = crow::json::load(req.body);
+            if (!jsonData || jsonData.t() != crow::json::type::Object)
+                co_return crow::response(400, "Missing or invalid JSON");
+
+            // Набор переданных полей определяет текст запроса, для каждого набора запрос готовится один раз
+            // на соединении. Параметры: id задачи, id пользователя и значения переданных полей
+            std::string set;
+            int mask = 0;
+            int paramCount = 2;
+            std::vector<std::optional<std::string>> params{ toQueryParam(task_id), toQueryParam(user_id) };
+            for (int i = 0; i != PATCH_COLUMNS_COUNT; ++i)
             {
-                return crow::response(500, "Internal server error");
+                if (!jsonData.has(PATCH_COLUMNS[i]))
+                    continue;
+
+                mask |= 1 << i;
+                if (!set.empty())
+                    set += ", ";
+                set += std::string(PATCH_COLUMNS[i]) + " = $" + std::to_string(++paramCount);
+
+                // null в JSON записывается как NULL (например, срок задачи снимается)
+                const auto& value = jsonData[PATCH_COLUMNS[i]];
+                if (value.t() == crow::json::type::Null)
+                    params.push_back(std::nullopt);
+                else if (value.t() == crow::json::type::Number)
+                    params.push_back(toQueryParam(static_cast<int>(value.i())));
+                else
+                    params.push_back(toQueryParam(std::string(value.s())));
             }
 
-            pqxx::nontransaction txn(db);
-            auto result = txn.exec_params(
-                R"(SELECT t.task_id, t.task_name, t.description, t.priority, t.due_date,
-                s.status_name, COALESCE(array_agg(tag.tag_name), '{}') AS tags
-                FROM tasks t
-                LEFT JOIN task_tags tt ON t.task_id = tt.task_id
-                LEFT JOIN tags tag ON tt.tag_id = tag.tag_id
-                LEFT JOIN task_statuses s ON t.status_id = s.status_id
-                WHERE t.task_id = $1 AND t.user_id = $2
-                GROUP BY t.task_id, s.status_name)",
-                task_id, user_id
-            );
+            bool hasTags = jsonData.has("tags");
+            if (mask == 0 && !hasTags)
+                co_return crow::response(400, "Nothing to update");
+
+            // Если меняются только теги, строка задачи все равно обновляется, чтобы триггер увеличил версию
+            if (set.empty())
+                set = "updated_at = NOW()";
+
+            if (!TaskIdFilter::getInstance().mayExist(task_id))
+                co_return crow::response(404, "Task not found");
+
+            // Первый запрос блокирует строку задачи до конца транзакции pipeline и читает версию, которую
+            // меняет PATCH: по ней проверяется, что в кэше лежит именно эта версия задачи
+            std::string name = "patch_task_" + std::to_string(mask);
+            std::vector<Statement> statements;
+            statements.push_back(statement("SELECT version FROM tasks WHERE task_id = $1 AND user_id = $2 FOR UPDATE", task_id, user_id));
+            statements.push_back({
+                R"(WITH upd AS (
+                UPDATE tasks SET )" + set + R"(
+                WHERE task_id = $1 AND user_id = $2
+                RETURNING status_id, priority, due_date, version),
+                ver AS (
+                UPDATE users SET tasks_version = tasks_version + 1
+                WHERE user_id = $2 AND EXISTS (SELECT 1 FROM upd)
+                RETURNING tasks_version)
+                SELECT upd.status_id, upd.priority, upd.due_date, upd.version, ver.tasks_version,
+                EXISTS (SELECT 1 FROM tasks WHERE task_id = $1) AS task_exists
+                FROM (SELECT 1) AS one
+                LEFT JOIN upd ON true
+                LEFT JOIN ver ON true)",
+                std::move(params), name });
+
+            // Замена тегов уходит в том же pipeline
+            if (hasTags)
+                for (auto& tagsStatement : tag::setTaskTagsQueries(task_id, user_id, tag::tagsFromJson(jsonData)))
+                    statements.push_back(std::move(tagsStatement));
+
+            auto results = co_await asyncPipeline(name.c_str(), std::move(statements));
+            const auto& result = results[1];
+            if (result.isNull(0, "version"))
+            {
+                co_await saveMissingTaskInCacheAsync(task_id, user_id);
+                if (result.boolean(0, "task_exists"))
+                    co_return crow::response(403, "Access denied");
+                co_return crow::response(404, "Task not found");
+            }
 
-            if (result.empty())
+            // Изменившиеся поля в том виде, в котором их отдает GET
+            crow::json::wvalue fields;
+            if (jsonData.has("task_name"))
+                fields["task_name"] = std::string(jsonData["task_name"].s());
+            if (jsonData.has("description"))
+                fields["description"] = std::string(jsonData["description"].s());
+            if (jsonData.has("status_id"))
+            {
+                int status_id = static_cast<int>(result.integer(0, "status_id"));
+                auto names = co_await Dictionaries::getInstance().snapshotFor(std::vector<int>(1, status_id), std::vector<int>());
+                fields["status"] = std::string(names.statusName(status_id));
+            }
+            if (jsonData.has("priority"))
+                fields["priority"] = result.integer(0, "priority");
+            if (jsonData.has("due_date"))
             {
-                return crow::response(403, "Access denied");
+                if (result.isNull(0, "due_date"))
+                    fields["due_date"] = nullptr;
+                else
+                    fields["due_date"] = result.text(0, "due_date");
             }
 
-            crow::json::wvalue response;
-            response["task_id"] = result[0]["task_id"].as<int>();
-            response["task_name"] = result[0]["task_name"].as<std::string>();
-            response["description"] = result[0]["description"].as<std::string>();
-            response["status"] = result[0]["status_name"].as<std::string>();
-            response["priority"] = result[0]["priority"].as<int>();
-            response["due_date"] = result[0]["due_date"].as<std::string>();
+            if (hasTags)
+            {
+                std::vector<std::string> tags = tag::tagNamesFromResult(results.back());
+                fields["tags"] = crow::json::wvalue::list();
+                for (size_t i = 0; i != tags.size(); ++i)
+                    fields["tags"][i] = tags[i];
+            }
 
-            auto tags = result[0]["tags"].as<std::string>();
-            tag::addTagsToResponse(tags, response);
+            std::string taskEtag = etag::forTask(task_id, result.integer(0, "version"));
 
-            // Сохраняем задачу в кэш
-            saveTaskInCache(task_id, user_id, response);
+            // Меняем в кэше только переданные поля
+            co_await patchTaskInCacheAsync(task_id, user_id, etag::forTask(task_id, results[0].integer(0, "version")), taskEtag, fields);
+            co_await saveTaskListVersionInCacheAsync(user_id, result.integer(0, "tasks_version"));
 
-            return crow::response(response);
+            crow::response response(200, "Task updated successfully");
+            response.set_header("ETag", taskEtag);
+            co_return response;
         }
         catch (const std::exception& e)
         {
-            return crow::response(400, e.what());
+            co_return crow::response(400, e.what());
+        }
+    }
+
+    // Результат загрузки задачи из бд, общий для всех запросов, ожидающих одну загрузку
+    struct LoadedTask
+    {
+        int code = 200;
+        std::string etag;
+        std::string body;
+    };
+
+    // Одновременные промахи кэша по одной задаче выполняют только один запрос к бд
+    AsyncSingleFlight<LoadedTask> taskLoads;
+
+    // Запись задачи из строки результата. Строки берутся из результата и справочников без копирования
+    void writeTask(JsonWriter& writer, const PgResult& result, int row, Dictionaries::Snapshot& names)
+    {
+        writer.beginObject();
+        writeTaskFields(writer, result.integer(row, "task_id"), result.view(row, "task_name"), result.view(row, "description"),
+            names.statusName(static_cast<int>(result.integer(row, "status_id"))), result.integer(row, "priority"),
+            result.isNull(row, "due_date") ? std::nullopt : std::optional<std::string_view>(result.view(row, "due_date")));
+
+        // Названия статуса и тегов берутся из справочников, без соединения с task_statuses и tags
+        tag::writeTagNames(result.view(row, "tag_ids"), names, writer);
+        writer.endObject();
+    }
+
+    // Снимок справочников, в котором есть все статусы и теги результата. Недостающие названия
+    // дочитываются запросом к бд, а не синхронно во время сборки JSON
+    asio::awaitable<Dictionaries::Snapshot> namesFor(const PgResult& result)
+    {
+        std::vector<int> status_ids;
+        std::vector<int> tag_ids;
+        for (int i = 0; i != result.size(); ++i)
+        {
+            status_ids.push_back(static_cast<int>(result.integer(i, "status_id")));
+            forEachId(result.view(i, "tag_ids"), [&tag_ids](int tag_id) { tag_ids.push_back(tag_id); });
+        }
+
+        co_return co_await Dictionaries::getInstance().snapshotFor(std::move(status_ids), std::move(tag_ids));
+    }
+
+    asio::awaitable<LoadedTask> loadTask(int task_id, int user_id, trace::Trace* requestTrace)
+    {
+        LoadedTask loaded;
+        RequestArena arena;
+
+        auto result = co_await asyncQuery(requestTrace, "get_task",
+            R"(SELECT t.task_id, t.task_name, t.description, t.priority, t.due_date, t.version, t.status_id,
+            ARRAY(SELECT tt.tag_id FROM task_tags tt WHERE tt.task_id = t.task_id ORDER BY tt.tag_id) AS tag_ids
+            FROM tasks t
+            WHERE t.task_id = $1 AND t.user_id = $2)",
+            task_id, user_id
+        );
+
+        if (result.empty())
+        {
+            co_await saveMissingTaskInCacheAsync(task_id, user_id);
+            loaded.code = 403;
+            co_return loaded;
         }
+
+        auto names = co_await namesFor(result);
+        trace::Span render(requestTrace, "json.render");
+        JsonWriter writer(arena.resource());
+        writeTask(writer, result, 0, names);
+        render.end();
+
+        loaded.etag = etag::forTask(task_id, result.integer(0, "version"));
+        loaded.body = writer.str(); // Результат общий для всех ожидающих, поэтому копируется из арены
+
+        // Сохраняем задачу в кэш
+        trace::Span save(requestTrace, "redis.save_task");
+        co_await saveTaskInCacheAsync(task_id, user_id, loaded.body, loaded.etag, arena.resource());
+
+        co_return loaded;
     }
 
-    crow::response deleteTask(const crow::request& req, int task_id)
+    // Ответ с уже сериализованной задачей
+    crow::response taskResponse(const crow::request& req, const std::string& taskEtag, std::string body)
     {
+        if (etag::matches(req, taskEtag))
+            return etag::notModified(taskEtag);
+
+        crow::response response(std::move(body));
+        response.set_header("Content-Type", "application/json");
+        response.set_header("ETag", taskEtag);
+        return response;
+    }
+
+    asio::awaitable<crow::response> getTask(const crow::request& req, int task_id)
+    {
+        // Трасса по участкам: проверка токена, Redis, ожидание соединения и запрос к бд, сборка JSON
+        trace::Trace requestTrace(req, "GET /tasks/{task_id}");
         try
         {
             int user_id;
+            trace::Span authSpan(&requestTrace, "auth.check_token");
             if (!auth::checkToken(req, user_id))
-                return crow::response(401, "Missing or invalid authorization token");
+                co_return requestTrace.finish(crow::response(401, "Missing or invalid authorization token"));
+            authSpan.end();
 
-            auto db = connectDB();
-            if (!db.is_open())
-                return crow::response(500, "Internal server error");
+            // Несуществующую задачу отсекаем без обращения к кэшу и бд
+            if (!TaskIdFilter::getInstance().mayExist(task_id))
+                co_return requestTrace.finish(crow::response(403, "Access denied"));
 
-            pqxx::work txn(db);
+            std::string cacheKey = createCacheKey(task_id, user_id);
+            trace::Span cacheGet(&requestTrace, "redis.get_task");
+            CachedTask cached = co_await getTaskFromCacheAsync(task_id, user_id);
+            cacheGet.attribute("cache.result", cached.missing ? "missing" : cached.body.empty() ? "miss" : cached.stale ? "stale" : "hit");
+            cacheGet.end();
 
-            auto result = txn.exec_params(
-                "SELECT task_id FROM tasks WHERE task_id = $1 AND user_id = $2", task_id, user_id
-            );
+            if (cached.missing)
+                co_return requestTrace.finish(crow::response(403, "Access denied"));
 
-            if (result.empty()) {
-                return crow::response(404, "Task not found");
-            }
+            // Свежую задачу из кэша отдаем как есть, не разбирая JSON. Устаревшую отдаем,
+            // только если ее уже обновляет другой запрос
+            if (!cached.body.empty() && (!cached.stale || taskLoads.inProgress(cacheKey)))
+                co_return requestTrace.finish(taskResponse(req, cached.etag, std::move(cached.body)));
+
+            // Если задачи нет в кэше, идем в бд (один запрос на все одновременные промахи)
+            // Участки бд записывает только запрос, который выполняет загрузку, остальные ждут ее результата
+            trace::Span load(&requestTrace, "task.load");
+            LoadedTask loaded = co_await taskLoads.run(cacheKey, [task_id, user_id, &requestTrace] { return loadTask(task_id, user_id, &requestTrace); });
+            load.end();
+
+            if (loaded.code == 403)
+                co_return requestTrace.finish(crow::response(403, "Access denied"));
+
+            co_return requestTrace.finish(taskResponse(req, loaded.etag, std::move(loaded.body)));
+        }
+        catch (const std::exception& e)
+        {
+            co_return requestTrace.finish(crow::response(400, e.what()));
+        }
+    }
 
-            txn.exec_params("DELETE FROM task_tags WHERE task_id = $1", task_id);
-            txn.exec_params("DELETE FROM tasks WHERE task_id = $1", task_id);
+    asio::awaitable<crow::response> deleteTask(const crow::request& req, int task_id)
+    {
+        try
+        {
+            int user_id;
+            if (!auth::checkToken(req, user_id))
+                co_return crow::response(401, "Missing or invalid authorization token");
+
+            auto& filter = TaskIdFilter::getInstance();
+            if (!filter.mayExist(task_id))
+                co_return crow::response(404, "Task not found");
+            unsigned long long filterGeneration = filter.generation();
+
+            // Удаление с проверкой владельца одним запросом, теги и комментарии удаляются каскадно
+            auto result = co_await asyncQuery("delete_task",
+                R"(WITH del AS (
+                DELETE FROM tasks WHERE task_id = $1 AND user_id = $2 RETURNING task_id),
+                ver AS (
+                UPDATE users SET tasks_version = tasks_version + 1
+                WHERE user_id = $2 AND EXISTS (SELECT 1 FROM del)
+                RETURNING tasks_version)
+                SELECT ver.tasks_version, EXISTS (SELECT 1 FROM tasks WHERE task_id = $1) AS task_exists
+                FROM (SELECT 1) AS one
+                LEFT JOIN ver ON true)",
+                task_id, user_id
+            );
 
-            txn.commit();
+            if (result.isNull(0, "tasks_version"))
+            {
+                co_await saveMissingTaskInCacheAsync(task_id, user_id);
+                if (result.boolean(0, "task_exists"))
+                    co_return crow::response(403, "Access denied");
+                co_return crow::response(404, "Task not found");
+            }
 
-            // Так же удаляем из кэша
-            deleteTaskFromCache(task_id, user_id);
+            // Так же удаляем из кэша и фильтра
+            filter.remove(task_id, filterGeneration);
+            co_await deleteTaskFromCacheAsync(task_id, user_id);
+            co_await saveTaskListVersionInCacheAsync(user_id, result.integer(0, "tasks_version"));
 
-            return crow::response(200, "Task deleted successfully");
+            co_return crow::response(200, "Task deleted successfully");
         }
         catch (const std::exception& e)
         {
-            return crow::response(400, e.what());
+            co_return crow::response(400, e.what());
         }
     }
 
+    // Запрос списка задач пользователя. Теги фильтра передаются параметром $1 (text[]), задача
+    // попадает в список, только если у нее есть все теги фильтра
     std::string buildQueryWithFilterTags(int user_id, const std::string& tagsFilter)
     {
         std::string query = R"(
-            SELECT t.task_id, t.task_name, t.description, t.priority, t.due_date, 
-            s.status_name, COALESCE(array_agg(tag.tag_name), '{}') AS tags
+            SELECT t.task_id, t.task_name, t.description, t.priority, t.due_date, t.status_id,
+            ARRAY(SELECT tt.tag_id FROM task_tags tt WHERE tt.task_id = t.task_id ORDER BY tt.tag_id) AS tag_ids
             FROM tasks t
-            LEFT JOIN task_tags tt ON t.task_id = tt.task_id
-            LEFT JOIN tags tag ON tt.tag_id = tag.tag_id
-            LEFT JOIN task_statuses s ON t.status_id = s.status_id
             WHERE t.user_id = )" + std::to_string(user_id);
 
         // Если в параметрах есть теги, то добавляем условие для фильтрации
         if (!tagsFilter.empty())
         {
-            std::vector<std::string> tags;
-            std::stringstream tag_stream(tagsFilter);
-            std::string tag;
-
-            while (std::getline(tag_stream, tag, ','))
-            {
-                tags.push_back(tag);
-            }
-
             query += R"(
                 AND t.task_id IN (
                 SELECT tt.task_id
                 FROM task_tags tt
                 JOIN tags tag ON tt.tag_id = tag.tag_id
-                WHERE tag.tag_name = ANY('{)" + tagsFilter + R"(}')
+                WHERE tag.tag_name = ANY($1::text[])
                 GROUP BY tt.task_id
-                HAVING COUNT(DISTINCT tag.tag_name) = )" + std::to_string(tags.size()) + ")";
+                HAVING COUNT(DISTINCT tag.tag_name) = (SELECT COUNT(DISTINCT name) FROM unnest($1::text[]) AS name)))";
         }
 
         query += R"(
-        GROUP BY t.task_id, s.status_id, s.status_name
         ORDER BY t.priority DESC, t.due_date ASC, t.task_id ASC)";
 
         return query;
     }
 
-    crow::response getAllTasks(const crow::request& req)
+    asio::awaitable<crow::response> getAllTasks(const crow::request& req)
     {
+        trace::Trace requestTrace(req, "GET /tasks");
         try
         {
             int user_id;
+            trace::Span authSpan(&requestTrace, "auth.check_token");
             if (!auth::checkToken(req, user_id))
-                return crow::response(401, "Missing or invalid authorization token");
-
-            auto db = connectDB();
-            if (!db.is_open())
-                return crow::response(500, "Internal Server Error");
+                co_return requestTrace.finish(crow::response(401, "Missing or invalid authorization token"));
+            authSpan.end();
+
+            // Проверяем ETag по версии из кэша до обращения к бд
+            std::string listEtag;
+            trace::Span cacheGet(&requestTrace, "redis.get_list_version");
+            long long listVersion = co_await getTaskListVersionFromCacheAsync(user_id);
+            cacheGet.end();
+            if (listVersion >= 0)
+            {
+                listEtag = etag::forTaskList(user_id, listVersion);
+                if (etag::matches(req, listEtag))
+                    co_return requestTrace.finish(etag::notModified(listEtag));
+            }
 
             crow::query_string qs(req.url_params);
             std::string tagsFilter = qs.get("tags") ? qs.get("tags") : "";
 
             std::string query = buildQueryWithFilterTags(user_id, tagsFilter);
 
-            pqxx::nontransaction txn(db);
-            pqxx::result result = txn.exec(query);
+            // Версия читается до списка, поэтому ETag никогда не окажется новее отданных данных
+            if (listVersion < 0)
+            {
+                auto versionResult = co_await asyncQuery(&requestTrace, "get_tasks_version", "SELECT tasks_version FROM users WHERE user_id = $1", user_id);
+                listVersion = versionResult.empty() ? 0 : versionResult.integer(0, "tasks_version");
+                co_await saveTaskListVersionInCacheAsync(user_id, listVersion);
 
-            crow::json::wvalue response;
-            response["tasks"] = crow::json::wvalue::list();
+                listEtag = etag::forTaskList(user_id, listVersion);
+                if (etag::matches(req, listEtag))
+                    co_return requestTrace.finish(etag::notModified(listEtag));
+            }
 
-            int index = 0;
-            for (const auto& row : result)
+            PgResult result;
+            if (tagsFilter.empty())
+            {
+                result = co_await asyncQuery(&requestTrace, "get_tasks", query);
+            }
+            else
             {
-                crow::json::wvalue task;
-                task["task_id"] = row["task_id"].as<int>();
-                task["task_name"] = row["task_name"].as<std::string>();
-                task["description"] = row["description"].as<std::string>();
-                task["status"] = row["status_name"].as<std::string>();
-                task["priority"] = row["priority"].as<int>();
-                task["due_date"] = row["due_date"].as<std::string>();
-
-                auto tags = row["tags"].as<std::string>();
-                tag::addTagsToResponse(tags, task);
-
-                response["tasks"][index++] = std::move(task);
+                std::vector<std::string> tags;
+                std::stringstream tag_stream(tagsFilter);
+                std::string tag;
+
+                while (std::getline(tag_stream, tag, ','))
+                {
+                    tags.push_back(tag);
+                }
+
+                result = co_await asyncQuery(&requestTrace, "get_tasks_by_tags", query, tags);
             }
 
-            return crow::response(response);
+            // Ответ собирается на арене запроса: одна строка вместо узла wvalue и копий строк на каждое поле
+            auto names = co_await namesFor(result);
+            trace::Span render(&requestTrace, "json.render");
+            RequestArena arena;
+            JsonWriter writer(arena.resource());
+
+            writer.beginObject();
+            writer.key("tasks");
+            writer.beginArray();
+            for (int i = 0; i != result.size(); ++i)
+                writeTask(writer, result, i, names);
+            writer.endArray();
+            writer.endObject();
+
+            crow::response listResponse(std::string(writer.str()));
+            listResponse.set_header("Content-Type", "application/json");
+            listResponse.set_header("ETag", listEtag);
+            co_return requestTrace.finish(std::move(listResponse));
         }
         catch (const std::exception& e)
         {
-            return crow::response(400, e.what());
+            co_return requestTrace.finish(crow::response(400, e.what()));
         }
     }
-}
\ No newline at end of file
+}
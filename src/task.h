@@ -2,18 +2,27 @@
 #define TASK_H
 
 #include "crow_all.h"
-#include <pqxx/pqxx>
 #include <string>
 #include "auth.h"
 #include "tag.h"
 #include "cache.h"
+#include "etag.h"
+#include "bloom.h"
+#include "async_database.h"
+#include "async_cache.h"
+#include "async_singleflight.h"
+#include "arena.h"
+#include "json_writer.h"
 
 namespace task
 {
-	crow::response createTask(const crow::request& req);
-	crow::response updateTask(const crow::request& req, int task_id);
-	crow::response getTask(const crow::request& req, int task_id);
-	crow::response getAllTasks(const crow::request& req);
-	crow::response deleteTask(const crow::request& req, int task_id);
+	asio::awaitable<crow::response> createTask(const crow::request& req);
+	asio::awaitable<crow::response> updateTask(const crow::request& req, int task_id);
+	asio::awaitable<crow::response> patchTask(const crow::request& req, int task_id);
+	asio::awaitable<crow::response> getTask(const crow::request& req, int task_id);
+	asio::awaitable<crow::response> getAllTasks(const crow::request& req);
+	asio::awaitable<crow::response> deleteTask(const crow::request& req, int task_id);
+
+	std::string buildQueryWithFilterTags(int user_id, const std::string& tagsFilter);
 }
 #endif 
\ No newline at end of file
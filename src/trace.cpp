@@ -0,0 +1,223 @@
+﻿#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace trace
+{
+    namespace
+    {
+        uint64_t randomId()
+        {
+            thread_local std::mt19937_64 rng(std::random_device{}());
+            uint64_t id;
+            while ((id = rng()) == 0) {}
+            return id;
+        }
+
+        std::string hex(uint64_t value)
+        {
+            char buffer[17];
+            std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+            return buffer;
+        }
+
+        bool parseHex(const std::string& text, size_t pos, size_t length, uint64_t& value)
+        {
+            value = 0;
+            for (size_t i = pos; i != pos + length; ++i)
+            {
+                char c = text[i];
+                int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+                if (digit < 0)
+                    return false;
+                value = value << 4 | digit;
+            }
+            return true;
+        }
+    }
+
+    long long nowNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Заголовок W3C traceparent: 00-<trace-id 32 hex>-<parent-id 16 hex>-<flags 2 hex>
+    Trace::Trace(const crow::request& req, const char* name) : isSampled(false), finished(false), traceHigh(0), traceLow(0)
+    {
+        uint64_t parentId = 0;
+        std::string header = req.get_header_value("traceparent");
+        if (header.size() == 55 && header[2] == '-' && header[35] == '-' && header[52] == '-')
+        {
+            uint64_t flags;
+            if (parseHex(header, 3, 16, traceHigh) && parseHex(header, 19, 16, traceLow)
+                && parseHex(header, 36, 16, parentId) && parseHex(header, 53, 2, flags))
+                isSampled = flags & 1;
+        }
+
+        if (!isSampled && TRACE_SAMPLE_RATE > 0)
+            isSampled = (randomId() >> 11) * 0x1.0p-53 < TRACE_SAMPLE_RATE;
+        if (!isSampled)
+            return;
+
+        // Без заголовка трасса начинается на сервере
+        if (traceHigh == 0 && traceLow == 0)
+        {
+            traceHigh = randomId();
+            traceLow = randomId();
+            parentId = 0;
+        }
+
+        SpanData root;
+        root.name = name;
+        root.spanId = randomId();
+        root.parentId = parentId;
+        root.start = nowNanos();
+        root.attributes.emplace_back("http.method", crow::method_name(req.method));
+        root.attributes.emplace_back("http.target", req.url);
+        spans.reserve(8);
+        spans.push_back(std::move(root));
+    }
+
+    // Трасса запроса, завершившегося исключением, тоже экспортируется
+    Trace::~Trace()
+    {
+        if (isSampled && !finished)
+            submit();
+    }
+
+    crow::response Trace::finish(crow::response response)
+    {
+        if (!isSampled || finished)
+            return response;
+
+        spans[0].attributes.emplace_back("http.status_code", std::to_string(response.code));
+        response.set_header("traceparent", "00-" + hex(traceHigh) + hex(traceLow) + "-" + hex(spans[0].spanId) + "-01");
+        submit();
+        return response;
+    }
+
+    // Участки, которые еще не закрыты, заканчиваются вместе с корневым
+    void Trace::submit()
+    {
+        finished = true;
+        long long now = nowNanos();
+        for (auto& span : spans)
+        {
+            if (span.end == 0)
+                span.end = now;
+        }
+        Exporter::getInstance().submit(traceHigh, traceLow, std::move(spans));
+    }
+
+    Span::Span(Trace* trace, const char* name) : trace(trace && trace->isSampled && !trace->finished ? trace : nullptr), index(0)
+    {
+        if (!this->trace)
+            return;
+
+        SpanData span;
+        span.name = name;
+        span.spanId = randomId();
+        span.parentId = this->trace->spans[0].spanId;
+        span.start = nowNanos();
+        index = this->trace->spans.size();
+        this->trace->spans.push_back(std::move(span));
+    }
+
+    void Span::attribute(const char* key, const std::string& value)
+    {
+        if (trace && !trace->finished)
+            trace->spans[index].attributes.emplace_back(key, value);
+    }
+
+    void Span::end()
+    {
+        if (trace && !trace->finished)
+            trace->spans[index].end = nowNanos();
+        trace = nullptr;
+    }
+
+    Exporter::Exporter() : droppedTraces(0)
+    {
+        std::thread([this] { run(); }).detach();
+    }
+
+    Exporter& Exporter::getInstance()
+    {
+        static Exporter exporter;
+        return exporter;
+    }
+
+    // При переполнении очереди трасса отбрасывается, чтобы не задерживать запрос
+    void Exporter::submit(uint64_t traceHigh, uint64_t traceLow, std::vector<SpanData> spans)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (queue.size() >= TRACE_QUEUE_LIMIT)
+        {
+            ++droppedTraces;
+            return;
+        }
+        queue.push_back({ traceHigh, traceLow, std::move(spans) });
+    }
+
+    unsigned long long Exporter::dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return droppedTraces;
+    }
+
+    // Пакет записывается как ExportTraceServiceRequest в JSON-кодировке OTLP, так же, как его пишет
+    // file exporter OpenTelemetry Collector, поэтому файл можно отдать коллектору или просмотрщику
+    void Exporter::run()
+    {
+        FILE* file = std::fopen(TRACE_FILE.c_str(), "a");
+        if (!file)
+        {
+            CROW_LOG_ERROR << "Cannot open " << TRACE_FILE << ", traces are discarded";
+            return;
+        }
+
+        while (true)
+        {
+            std::deque<Exported> batch;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                ready.wait_for(lock, std::chrono::seconds(TRACE_FLUSH_INTERVAL));
+                batch.swap(queue);
+            }
+            if (batch.empty())
+                continue;
+
+            std::string json = R"({"resourceSpans":[{"resource":{"attributes":[{"key":"service.name","value":{"stringValue":"taskManager"}}]},)"
+                R"("scopeSpans":[{"scope":{"name":"taskManager"},"spans":[)";
+            bool first = true;
+            for (const auto& exported : batch)
+            {
+                std::string traceId = hex(exported.traceHigh) + hex(exported.traceLow);
+                for (size_t i = 0; i != exported.spans.size(); ++i)
+                {
+                    const SpanData& span = exported.spans[i];
+                    json += first ? "" : ",";
+                    first = false;
+                    json += R"({"traceId":")" + traceId + R"(","spanId":")" + hex(span.spanId) + R"(",)";
+                    if (span.parentId)
+                        json += R"("parentSpanId":")" + hex(span.parentId) + R"(",)";
+                    json += R"("name":")" + crow::json::escape(span.name) + R"(","kind":)" + (i == 0 ? "2" : "1")
+                        + R"(,"startTimeUnixNano":")" + std::to_string(span.start)
+                        + R"(","endTimeUnixNano":")" + std::to_string(span.end ? span.end : span.start) + R"(","attributes":[)";
+                    for (size_t j = 0; j != span.attributes.size(); ++j)
+                    {
+                        json += (j ? "," : "") + (R"({"key":")" + span.attributes[j].first + R"(","value":{"stringValue":")"
+                            + crow::json::escape(span.attributes[j].second) + R"("}})");
+                    }
+                    json += "]}";
+                }
+            }
+            json += "]}]}]}\n";
+
+            std::fwrite(json.data(), 1, json.size(), file);
+            std::fflush(file);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+﻿#ifndef TRACE_H
+#define TRACE_H
+
+#include "crow_all.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+const double TRACE_SAMPLE_RATE = 0.0; // Доля запросов, которые трассируются без заголовка traceparent
+const std::string TRACE_FILE = "traces.jsonl"; // Файл экспорта в формате OTLP/JSON, по строке на пакет
+const size_t TRACE_QUEUE_LIMIT = 10000; // Сколько трасс может ждать экспорта, лишние отбрасываются
+const int TRACE_FLUSH_INTERVAL = 1; // Период записи пакета (сек)
+
+namespace trace
+{
+    struct SpanData
+    {
+        std::string name;
+        uint64_t spanId = 0;
+        uint64_t parentId = 0;
+        long long start = 0; // Unix-время в наносекундах
+        long long end = 0;
+        std::vector<std::pair<std::string, std::string>> attributes;
+    };
+
+    class Trace;
+
+    // Участок обработки запроса. Для трассы без выборки ничего не делает и не читает часы
+    class Span
+    {
+    public:
+        Span(Trace* trace, const char* name);
+        ~Span() { end(); }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        void attribute(const char* key, const std::string& value);
+        void end();
+
+    private:
+        Trace* trace;
+        size_t index;
+    };
+
+    // Трасса одного запроса. Решение о выборке принимается при создании: запрос трассируется, если
+    // клиент прислал traceparent с флагом sampled, или с вероятностью TRACE_SAMPLE_RATE. Корневой
+    // участок длится от создания трассы до finish, все остальные участки - его дочерние
+    class Trace
+    {
+    public:
+        Trace(const crow::request& req, const char* name);
+        ~Trace();
+        Trace(const Trace&) = delete;
+        Trace& operator=(const Trace&) = delete;
+
+        bool sampled() const { return isSampled; }
+
+        // Завершение трассы по ответу: код ответа в атрибутах и traceparent в заголовках
+        crow::response finish(crow::response response);
+
+    private:
+        friend class Span;
+
+        bool isSampled;
+        bool finished;
+        uint64_t traceHigh;
+        uint64_t traceLow;
+        std::vector<SpanData> spans; // Первый участок - корневой
+
+        void submit();
+    };
+
+    // Фоновая запись трасс в TRACE_FILE пакетами. Потоки запросов только кладут трассу в очередь
+    class Exporter
+    {
+    public:
+        static Exporter& getInstance();
+        void submit(uint64_t traceHigh, uint64_t traceLow, std::vector<SpanData> spans);
+        unsigned long long dropped() const;
+
+    private:
+        Exporter();
+
+        struct Exported
+        {
+            uint64_t traceHigh;
+            uint64_t traceLow;
+            std::vector<SpanData> spans;
+        };
+
+        mutable std::mutex mtx;
+        std::condition_variable ready;
+        std::deque<Exported> queue;
+        unsigned long long droppedTraces;
+
+        void run();
+    };
+
+    long long nowNanos();
+}
+
+#endif
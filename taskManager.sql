@@ -47,6 +47,23 @@ $$;
 
 ALTER FUNCTION public.update_updated_at() OWNER TO postgres;
 
+--
+-- Name: update_task_version(); Type: FUNCTION; Schema: public; Owner: postgres
+--
+
+CREATE FUNCTION public.update_task_version() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+BEGIN
+    NEW.version = OLD.version + 1;
+    NEW.updated_at = NOW();
+    RETURN NEW;
+END;
+$$;
+
+
+ALTER FUNCTION public.update_task_version() OWNER TO postgres;
+
 SET default_tablespace = '';
 
 SET default_table_access_method = heap;
@@ -183,6 +200,7 @@ CREATE TABLE public.tasks (
     due_date date,
     created_at timestamp without time zone DEFAULT CURRENT_TIMESTAMP,
     updated_at timestamp without time zone DEFAULT CURRENT_TIMESTAMP,
+    version integer DEFAULT 1 NOT NULL,
     CONSTRAINT tasks_priority_check CHECK ((priority >= 0))
 );
 
@@ -220,7 +238,8 @@ CREATE TABLE public.users (
     username character varying(100) NOT NULL,
     email character varying(100) NOT NULL,
     password character varying(200) NOT NULL,
-    salt character varying(100)
+    salt character varying(100),
+    tasks_version bigint DEFAULT 0 NOT NULL
 );
 
 
@@ -322,7 +341,7 @@ COPY public.task_tags (task_id, tag_id) FROM stdin;
 -- Data for Name: tasks; Type: TABLE DATA; Schema: public; Owner: postgres
 --
 
-COPY public.tasks (task_id, user_id, status_id, task_name, description, priority, due_date, created_at, updated_at) FROM stdin;
+COPY public.tasks (task_id, user_id, status_id, task_name, description, priority, due_date, created_at, updated_at, version) FROM stdin;
 \.
 
 
@@ -330,7 +349,7 @@ COPY public.tasks (task_id, user_id, status_id, task_name, description, priority
 -- Data for Name: users; Type: TABLE DATA; Schema: public; Owner: postgres
 --
 
-COPY public.users (user_id, username, email, password, salt) FROM stdin;
+COPY public.users (user_id, username, email, password, salt, tasks_version) FROM stdin;
 \.
 
 
@@ -500,6 +519,13 @@ CREATE INDEX idx_user_comments ON public.comments USING btree (user_id);
 CREATE TRIGGER update_comments_updated_at BEFORE UPDATE ON public.comments FOR EACH ROW EXECUTE FUNCTION public.update_updated_at();
 
 
+--
+-- Name: tasks update_tasks_version; Type: TRIGGER; Schema: public; Owner: postgres
+--
+
+CREATE TRIGGER update_tasks_version BEFORE UPDATE ON public.tasks FOR EACH ROW EXECUTE FUNCTION public.update_task_version();
+
+
 --
 -- Name: comments comments_task_id_fkey; Type: FK CONSTRAINT; Schema: public; Owner: postgres
 --
@@ -1,8 +1,29 @@
+import os
 import unittest
+import pytest
 import requests
 import uuid
 
 BASE_URL = "http://localhost:8080"
+
+
+def read_debug_token():
+    token = os.environ.get("DEBUG_TOKEN")
+    if token:
+        return token
+    env_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".env")
+    if os.path.exists(env_path):
+        with open(env_path) as env_file:
+            for line in env_file:
+                name, _, value = line.strip().partition("=")
+                if name == "DEBUG_TOKEN":
+                    return value.strip().strip('"')
+    return ""
+
+
+DEBUG_TOKEN = read_debug_token()
+requires_debug_token = pytest.mark.skipif(not DEBUG_TOKEN, reason="DEBUG_TOKEN is not set")
+
 task_id = None
 auth_token = None
 
@@ -91,6 +112,17 @@ def test_get_task():
     assert json_data["task_id"] == task_id
 
 
+def test_get_task_not_modified():
+    global task_id
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=headers)
+    assert response.status_code == 200
+    assert "ETag" in response.headers
+
+    conditional_headers = dict(headers, **{"If-None-Match": response.headers["ETag"]})
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=conditional_headers)
+    assert response.status_code == 304
+
+
 def test_get_task_wrong_id():
     global task_id
     response = requests.get(f"{BASE_URL}/tasks/1000000000", headers=headers)
@@ -119,6 +151,58 @@ def test_update_task():
     assert json_data["due_date"] == updated_payload["due_date"]
 
 
+def test_update_task_tags():
+    global task_id
+    payload = {
+        "task_name": f"Task {uuid.uuid4()}",
+        "description": "test",
+        "tags": ["keep", "drop"]
+    }
+    response = requests.put(f"{BASE_URL}/tasks/{task_id}", json=payload, headers=headers)
+    assert response.status_code == 200
+
+    payload["tags"] = ["keep", "new"]
+    response = requests.put(f"{BASE_URL}/tasks/{task_id}", json=payload, headers=headers)
+    assert response.status_code == 200
+
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=headers)
+    assert response.status_code == 200
+    assert sorted(response.json()["tags"]) == ["keep", "new"]
+
+
+def test_patch_task():
+    global task_id
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=headers)
+    assert response.status_code == 200
+    before = response.json()
+
+    response = requests.patch(f"{BASE_URL}/tasks/{task_id}", json={"priority": 5}, headers=headers)
+    assert response.status_code == 200
+
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=headers)
+    assert response.status_code == 200
+    json_data = response.json()
+    assert json_data["priority"] == 5
+    assert json_data["task_name"] == before["task_name"]
+    assert json_data["tags"] == before["tags"]
+
+
+def test_patch_task_empty():
+    global task_id
+    response = requests.patch(f"{BASE_URL}/tasks/{task_id}", json={}, headers=headers)
+    assert response.status_code == 400
+
+
+def test_patch_task_clear_due_date():
+    global task_id
+    response = requests.patch(f"{BASE_URL}/tasks/{task_id}", json={"due_date": None}, headers=headers)
+    assert response.status_code == 200
+
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=headers)
+    assert response.status_code == 200
+    assert response.json()["due_date"] is None
+
+
 def test_update_task_wrong_id():
     response = requests.put(f"{BASE_URL}/tasks/1000000000", headers=headers)
     assert response.status_code == 400
@@ -131,6 +215,25 @@ def test_get_all_tasks():
     assert "tasks" in json_data  
 
 
+def test_get_all_tasks_not_modified():
+    global task_id
+    response = requests.get(f"{BASE_URL}/tasks", headers=headers)
+    assert response.status_code == 200
+    etag = response.headers["ETag"]
+
+    conditional_headers = dict(headers, **{"If-None-Match": etag})
+    response = requests.get(f"{BASE_URL}/tasks", headers=conditional_headers)
+    assert response.status_code == 304
+
+    tags_payload = {"tags": ["etag_tag"]}
+    response = requests.post(f"{BASE_URL}/tasks/{task_id}/tags", json=tags_payload, headers=headers)
+    assert response.status_code == 200
+
+    response = requests.get(f"{BASE_URL}/tasks", headers=conditional_headers)
+    assert response.status_code == 200
+    assert response.headers["ETag"] != etag
+
+
 def test_add_tags_to_task():
     global task_id
     tags_payload = {"tags": ["tag1", "tag2"]}
@@ -145,6 +248,41 @@ def test_add_tags_to_task():
     assert set(tags_payload["tags"]).issubset(set(json_data["tags"]))
 
 
+def test_add_tags_with_special_characters():
+    global task_id
+    tags_payload = {"tags": ["a,b", "quote\"tag"]}
+    response = requests.post(f"{BASE_URL}/tasks/{task_id}/tags", json=tags_payload, headers=headers)
+    assert response.status_code == 200
+
+    response = requests.get(f"{BASE_URL}/tasks/{task_id}", headers=headers)
+    assert response.status_code == 200
+    assert set(tags_payload["tags"]).issubset(set(response.json()["tags"]))
+
+
+def test_add_tags_wrong_id():
+    tags_payload = {"tags": ["tag1"]}
+    response = requests.post(f"{BASE_URL}/tasks/1000000000/tags", json=tags_payload, headers=headers)
+    assert response.status_code == 404
+
+
+@requires_debug_token
+def test_allocation_budgets():
+    debug_headers = dict(headers, **{"X-Debug-Token": DEBUG_TOKEN})
+    budgets = {
+        f"/tasks/{task_id}": 2000,
+        "/tasks": 5000,
+        f"/tasks/{task_id}/comments": 3000,
+    }
+    for path, budget in budgets.items():
+        response = requests.get(f"{BASE_URL}{path}", headers=debug_headers)
+        assert response.status_code in (200, 304)
+        assert int(response.headers["X-Alloc-Count"]) <= budget, path
+
+    response = requests.get(f"{BASE_URL}/debug/allocations", headers=debug_headers)
+    assert response.status_code == 200
+    assert response.json()["routes"]["GET /tasks/{id}"]["requests"] >= 1
+
+
 def test_delete_task():
     global task_id
     response = requests.delete(f"{BASE_URL}/tasks/{task_id}", headers=headers)
@@ -160,6 +298,37 @@ def test_delete_task_wrong_id():
     assert response.status_code == 404
 
 
+
+@requires_debug_token
+def test_debug_profile():
+    response = requests.get(f"{BASE_URL}/debug/profile?seconds=1", headers=headers)
+    assert response.status_code == 404
+
+    debug_headers = {"X-Debug-Token": DEBUG_TOKEN}
+    response = requests.get(f"{BASE_URL}/debug/profile?seconds=1&mode=alloc", headers=debug_headers)
+    assert response.status_code == 200
+    assert response.headers["Content-Type"].startswith("text/plain")
+    for line in response.text.splitlines():
+        assert line.rsplit(" ", 1)[1].isdigit()
+
+@requires_debug_token
+def test_debug_redis():
+    response = requests.get(f"{BASE_URL}/debug/redis")
+    assert response.status_code == 404
+
+    response = requests.get(f"{BASE_URL}/debug/redis", headers={"X-Debug-Token": DEBUG_TOKEN})
+    assert response.status_code == 200
+    assert response.json()["state"] == "closed"
+
+@requires_debug_token
+def test_debug_admission():
+    response = requests.get(f"{BASE_URL}/debug/admission", headers={"X-Debug-Token": DEBUG_TOKEN})
+    assert response.status_code == 200
+    for route_class in ("auth", "read", "write"):
+        assert response.json()[route_class]["limit"] >= 4
+    assert response.json()["users"]["rejected"] >= 0
+    assert response.json()["rate_limit"]["buckets"] >= 1
+
 if __name__ == "__main__":
     test_login()
     test_create_task()